@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+# include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+// Every kernel takes any address and stride, so accesses may straddle lines
+// and pages.  Loads sum into two accumulators to keep the add chain off the
+// critical path.
+static uint64_t load_scalar(const void *ptr, size_t count, size_t stride) {
+    const char *p = ptr;
+    uint64_t a = 0, b = 0;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint64_t x, y;
+        __builtin_memcpy(&x, p + i * stride, sizeof(x));
+        __builtin_memcpy(&y, p + (i + 1) * stride, sizeof(y));
+        a += x;
+        b += y;
+    }
+    if (i < count) {
+        uint64_t x;
+        __builtin_memcpy(&x, p + i * stride, sizeof(x));
+        a += x;
+    }
+    return a + b;
+}
+
+
+static void store_scalar(void *ptr, size_t count, size_t stride, uint64_t v) {
+    char *p = ptr;
+    for (size_t i = 0; i < count; i++) {
+        __builtin_memcpy(p + i * stride, &v, sizeof(v));
+    }
+}
+
+
+#ifdef __AVX2__
+static uint64_t load_avx2(const void *ptr, size_t count, size_t stride) {
+    const char *p = ptr;
+    __m256i a = _mm256_setzero_si256();
+    __m256i b = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        a = _mm256_add_epi64(a, _mm256_loadu_si256((const __m256i*) (p + i * stride)));
+        b = _mm256_add_epi64(b, _mm256_loadu_si256((const __m256i*) (p + (i + 1) * stride)));
+    }
+    if (i < count) {
+        a = _mm256_add_epi64(a, _mm256_loadu_si256((const __m256i*) (p + i * stride)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*) lanes, _mm256_add_epi64(a, b));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+
+static void store_avx2(void *ptr, size_t count, size_t stride, uint64_t v) {
+    char *p = ptr;
+    const __m256i vec = _mm256_set1_epi64x(v);
+    for (size_t i = 0; i < count; i++) {
+        _mm256_storeu_si256((__m256i*) (p + i * stride), vec);
+    }
+}
+
+
+# ifdef __AVX512F__
+static uint64_t load_avx512(const void *ptr, size_t count, size_t stride) {
+    const char *p = ptr;
+    __m512i a = _mm512_setzero_si512();
+    __m512i b = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        a = _mm512_add_epi64(a, _mm512_loadu_si512(p + i * stride));
+        b = _mm512_add_epi64(b, _mm512_loadu_si512(p + (i + 1) * stride));
+    }
+    if (i < count) {
+        a = _mm512_add_epi64(a, _mm512_loadu_si512(p + i * stride));
+    }
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(a, b));
+}
+
+
+static void store_avx512(void *ptr, size_t count, size_t stride, uint64_t v) {
+    char *p = ptr;
+    const __m512i vec = _mm512_set1_epi64(v);
+    for (size_t i = 0; i < count; i++) {
+        _mm512_storeu_si512(p + i * stride, vec);
+    }
+}
+# endif  // avx512
+#endif  // avx2
+
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+static uint64_t load_neon(const void *ptr, size_t count, size_t stride) {
+    const uint8_t *p = ptr;
+    uint64x2_t a = vdupq_n_u64(0);
+    uint64x2_t b = vdupq_n_u64(0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        a = vaddq_u64(a, vreinterpretq_u64_u8(vld1q_u8(p + i * stride)));
+        b = vaddq_u64(b, vreinterpretq_u64_u8(vld1q_u8(p + (i + 1) * stride)));
+    }
+    if (i < count) {
+        a = vaddq_u64(a, vreinterpretq_u64_u8(vld1q_u8(p + i * stride)));
+    }
+    return vaddvq_u64(vaddq_u64(a, b));
+}
+
+
+static void store_neon(void *ptr, size_t count, size_t stride, uint64_t v) {
+    uint8_t *p = ptr;
+    const uint8x16_t vec = vreinterpretq_u8_u64(vdupq_n_u64(v));
+    for (size_t i = 0; i < count; i++) {
+        vst1q_u8(p + i * stride, vec);
+    }
+}
+#endif
+
+
+static const ms_align_impl_t align_impls[] = {
+    {"scalar", "64bit C loads/stores", sizeof(uint64_t), load_scalar, store_scalar},
+#ifdef __AVX2__
+    {"avx2", "256bit AVX2 vmovdqu", 32, load_avx2, store_avx2},
+# ifdef __AVX512F__
+    {"avx512", "512bit AVX512 vmovdqu64", 64, load_avx512, store_avx512},
+# endif
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    {"neon", "128bit NEON ld1/st1", 16, load_neon, store_neon},
+#endif
+    {NULL, NULL, 0, NULL, NULL}
+};
+
+
+const ms_align_impl_t *ms_align_impls(void) {
+    return align_impls;
+}
+
+
+int ms_align_bench(ms_ctx_t *ctx, const ms_align_impl_t *impl, bool store, void *ptr, size_t count,
+                   size_t stride, size_t min_accesses, ms_align_result_t *result) {
+    if (count < 1 || stride < impl->width) {
+        ms_set_error(ctx, "Invalid alignment bench args");
+        return -1;
+    }
+    volatile uint64_t sink = 0;
+    const size_t passes = MAX(min_accesses / count, 2);
+    // Warm up caches and TLBs
+    if (store) {
+        impl->store(ptr, count, stride, 0);
+    } else {
+        sink += impl->load(ptr, count, stride);
+    }
+    ctx->start_time = ms_time();
+    for (size_t p = 1; p <= passes; p++) {
+        if (store) {
+            impl->store(ptr, count, stride, p);
+            __asm__ __volatile__("" ::: "memory");
+        } else {
+            sink += impl->load(ptr, count, stride);
+        }
+    }
+    ctx->end_time = ms_time();
+    (void) sink;
+    result->accesses = passes * count;
+    result->time = ctx->end_time - ctx->start_time;
+    return 0;
+}
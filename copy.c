@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+# include <immintrin.h>
+#endif
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+// Overlapping head/tail moves for anything under 64 bytes, the same trick
+// libc implementations use to avoid a byte loop.
+static inline void copy_small(char *d, const char *s, size_t n) {
+    if (n >= 32) {
+        uint64_t a[4];
+        uint64_t b[4];
+        __builtin_memcpy(a, s, 32);
+        __builtin_memcpy(b, s + n - 32, 32);
+        __builtin_memcpy(d, a, 32);
+        __builtin_memcpy(d + n - 32, b, 32);
+    } else if (n >= 16) {
+        uint64_t a[2];
+        uint64_t b[2];
+        __builtin_memcpy(a, s, 16);
+        __builtin_memcpy(b, s + n - 16, 16);
+        __builtin_memcpy(d, a, 16);
+        __builtin_memcpy(d + n - 16, b, 16);
+    } else if (n >= 8) {
+        uint64_t a;
+        uint64_t b;
+        __builtin_memcpy(&a, s, 8);
+        __builtin_memcpy(&b, s + n - 8, 8);
+        __builtin_memcpy(d, &a, 8);
+        __builtin_memcpy(d + n - 8, &b, 8);
+    } else if (n >= 4) {
+        uint32_t a;
+        uint32_t b;
+        __builtin_memcpy(&a, s, 4);
+        __builtin_memcpy(&b, s + n - 4, 4);
+        __builtin_memcpy(d, &a, 4);
+        __builtin_memcpy(d + n - 4, &b, 4);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            d[i] = s[i];
+        }
+    }
+}
+
+
+static void copy_memcpy(void *dst, const void *src, size_t n) {
+    memcpy(dst, src, n);
+}
+
+
+#ifdef __x86_64__
+static void copy_movsb(void *dst, const void *src, size_t n) {
+    __asm__ __volatile__(
+        "rep movsb\n\t"
+        : "+D" (dst), "+S" (src), "+c" (n)
+        :
+        : "memory"
+    );
+}
+#endif  // x86_64
+
+
+#ifdef __AVX2__
+static void copy_avx2(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < 64) {
+        copy_small(d, s, n);
+        return;
+    }
+    const __m256i tail = _mm256_loadu_si256((const __m256i*) (s + n - 32));
+    for (size_t i = 0; i + 32 <= n; i += 32) {
+        _mm256_storeu_si256((__m256i*) (d + i), _mm256_loadu_si256((const __m256i*) (s + i)));
+    }
+    _mm256_storeu_si256((__m256i*) (d + n - 32), tail);
+}
+
+
+// Streaming stores need an aligned destination, so the unaligned head and
+// tail go through regular stores.
+static void copy_avx2_nt(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < 64) {
+        copy_small(d, s, n);
+        return;
+    }
+    const __m256i head = _mm256_loadu_si256((const __m256i*) s);
+    const __m256i tail = _mm256_loadu_si256((const __m256i*) (s + n - 32));
+    size_t i = 32 - ((uintptr_t) d & 31);
+    for (; i + 32 <= n; i += 32) {
+        _mm256_stream_si256((__m256i*) (d + i), _mm256_loadu_si256((const __m256i*) (s + i)));
+    }
+    _mm_sfence();
+    _mm256_storeu_si256((__m256i*) d, head);
+    _mm256_storeu_si256((__m256i*) (d + n - 32), tail);
+}
+
+
+# ifdef __AVX512F__
+static void copy_avx512(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < 128) {
+        copy_avx2(d, s, n);
+        return;
+    }
+    const __m512i tail = _mm512_loadu_si512(s + n - 64);
+    for (size_t i = 0; i + 64 <= n; i += 64) {
+        _mm512_storeu_si512(d + i, _mm512_loadu_si512(s + i));
+    }
+    _mm512_storeu_si512(d + n - 64, tail);
+}
+
+
+static void copy_avx512_nt(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < 128) {
+        copy_avx2(d, s, n);
+        return;
+    }
+    const __m512i head = _mm512_loadu_si512(s);
+    const __m512i tail = _mm512_loadu_si512(s + n - 64);
+    size_t i = 64 - ((uintptr_t) d & 63);
+    for (; i + 64 <= n; i += 64) {
+        _mm512_stream_si512((__m512i*) (d + i), _mm512_loadu_si512(s + i));
+    }
+    _mm_sfence();
+    _mm512_storeu_si512(d, head);
+    _mm512_storeu_si512(d + n - 64, tail);
+}
+# endif  // avx512
+#endif  // avx2
+
+
+#ifdef __aarch64__
+static void copy_armasm(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    if (n < 64) {
+        copy_small(d, s, n);
+        return;
+    }
+    size_t body = n & ~63UL;
+    __asm__ __volatile__(
+    "1: \n\t"
+        "ldp q0, q1, [%[s]]\n\t"
+        "ldp q2, q3, [%[s], #32]\n\t"
+        "add %[s], %[s], #64\n\t"
+        "stp q0, q1, [%[d]]\n\t"
+        "stp q2, q3, [%[d], #32]\n\t"
+        "add %[d], %[d], #64\n\t"
+        "subs %[len], %[len], #64\n\t"
+        "b.gt 1b\n\t"
+        : [d] "+r" (d),
+          [s] "+r" (s),
+          [len] "+r" (body)
+        :
+        : "v0", "v1", "v2", "v3", "cc", "memory"
+    );
+    // d and s have advanced past the body to the remainder.
+    copy_small(d, s, n & 63);
+}
+#endif  // aarch64
+
+
+static const ms_copy_impl_t copy_impls[] = {
+    {"memcpy", "libc memcpy()", copy_memcpy},
+#ifdef __x86_64__
+    {"movsb", "x86 rep movsb", copy_movsb},
+#endif
+#ifdef __AVX2__
+    {"avx2", "256bit AVX2 load/store loop", copy_avx2},
+    {"avx2_nt", "256bit AVX2 load/stream loop (non-temporal)", copy_avx2_nt},
+# ifdef __AVX512F__
+    {"avx512", "512bit AVX512 load/store loop", copy_avx512},
+    {"avx512_nt", "512bit AVX512 load/stream loop (non-temporal)", copy_avx512_nt},
+# endif
+#endif
+#ifdef __aarch64__
+    {"armasm", "ARM ASM LDP/STP q-register loop", copy_armasm},
+#endif
+    {NULL, NULL, NULL}
+};
+
+
+const ms_copy_impl_t *ms_copy_impls(void) {
+    return copy_impls;
+}
+
+
+int ms_copy_bench(ms_ctx_t *ctx, const ms_copy_impl_t *impl, void *dst, const void *src,
+                  size_t size, size_t min_bytes, ms_copy_result_t *result) {
+    if (size < 1) {
+        ms_set_error(ctx, "Invalid copy size");
+        return -1;
+    }
+    const size_t copies = MAX(min_bytes / size, 4);
+    const ms_copy_fn copy = impl->copy;
+    copy(dst, src, size);  // Warm up caches and TLBs
+    ctx->start_time = ms_time();
+    for (size_t i = 0; i < copies; i++) {
+        copy(dst, src, size);
+        __asm__ __volatile__("" ::: "memory");
+    }
+    ctx->end_time = ms_time();
+    result->size = size;
+    result->copies = copies;
+    result->time = ctx->end_time - ctx->start_time;
+    return 0;
+}
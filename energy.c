@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <glob.h>
+#include <sys/param.h>
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+// Zones are intel-rapl:P for packages and intel-rapl:P:N for their
+// subzones; the same driver serves AMD since Linux 5.8.
+#define RAPL_ZONES "/sys/class/powercap/intel-rapl:*"
+#define HWMON_NAMES "/sys/class/hwmon/hwmon*/name"
+
+
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char *line = fgets(buf, size, f);
+    fclose(f);
+    if (line == NULL) {
+        return -1;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+
+static int read_u64(const char *path, uint64_t *value) {
+    char buf[64];
+    if (read_line(path, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    char *end;
+    *value = strtoull(buf, &end, 10);
+    return end == buf ? -1 : 0;
+}
+
+
+// Add a counter if it can be read now; max_path may be NULL.
+static bool add_domain(ms_energy_t *energy, const char *name, const char *path, const char *max_path,
+                       int *denied) {
+    uint64_t uj;
+    if (energy->count == MS_ENERGY_MAX_DOMAINS) {
+        return false;
+    }
+    if (read_u64(path, &uj) != 0) {
+        if (errno == EACCES || errno == EPERM) {
+            (*denied)++;
+        }
+        return false;
+    }
+    ms_energy_domain_t *d = &energy->domains[energy->count++];
+    memset(d, 0, sizeof(*d));
+    snprintf(d->name, sizeof(d->name), "%s", name);
+    snprintf(d->path, sizeof(d->path), "%s", path);
+    if (max_path == NULL || read_u64(max_path, &d->max_uj) != 0) {
+        d->max_uj = 0;
+    }
+    return true;
+}
+
+
+static void add_rapl_zones(ms_energy_t *energy, int *denied) {
+    glob_t zones;
+    if (glob(RAPL_ZONES, 0, NULL, &zones) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < zones.gl_pathc; i++) {
+        const char *zone = zones.gl_pathv[i];
+        const char *id = strrchr(zone, '/') + strlen("/intel-rapl:");
+        bool subzone = strchr(id, ':') != NULL;
+        char path[256];
+        char name[32];
+        snprintf(path, sizeof(path), "%s/name", zone);
+        if (read_line(path, name, sizeof(name)) != 0) {
+            continue;
+        }
+        // Packages, and DRAM which RAPL meters outside the package.  Core
+        // and uncore are already part of their package.
+        if (subzone && strcmp(name, "dram") != 0) {
+            continue;
+        }
+        if (!subzone && strncmp(name, "package", 7) != 0 && strcmp(name, "dram") != 0) {
+            continue;
+        }
+        char label[64];
+        if (subzone) {
+            char parent[256];
+            char parent_name[24] = "?";
+            snprintf(parent, sizeof(parent), "%.*s/name", (int) (strrchr(zone, ':') - zone), zone);
+            read_line(parent, parent_name, sizeof(parent_name));
+            snprintf(label, sizeof(label), "%s/%s", parent_name, name);
+        } else {
+            snprintf(label, sizeof(label), "%s", name);
+        }
+        char energy_path[256];
+        char max_path[256];
+        snprintf(energy_path, sizeof(energy_path), "%s/energy_uj", zone);
+        snprintf(max_path, sizeof(max_path), "%s/max_energy_range_uj", zone);
+        add_domain(energy, label, energy_path, max_path, denied);
+    }
+    globfree(&zones);
+}
+
+
+// The out of tree amd_energy hwmon driver, per socket counters only.
+static void add_amd_energy(ms_energy_t *energy, int *denied) {
+    glob_t names;
+    if (glob(HWMON_NAMES, 0, NULL, &names) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < names.gl_pathc; i++) {
+        char name[64];
+        if (read_line(names.gl_pathv[i], name, sizeof(name)) != 0 || strcmp(name, "amd_energy") != 0) {
+            continue;
+        }
+        char dir[256];
+        snprintf(dir, sizeof(dir), "%.*s", (int) (strrchr(names.gl_pathv[i], '/') - names.gl_pathv[i]),
+            names.gl_pathv[i]);
+        for (int n = 1; n < 1024; n++) {
+            char path[256];
+            char label[64];
+            snprintf(path, sizeof(path), "%.200s/energy%d_label", dir, n);
+            if (read_line(path, label, sizeof(label)) != 0) {
+                break;
+            }
+            if (strncmp(label, "Esocket", 7) != 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%.200s/energy%d_input", dir, n);
+            add_domain(energy, label, path, NULL, denied);
+        }
+    }
+    globfree(&names);
+}
+
+
+int ms_energy_open(ms_ctx_t *ctx, ms_energy_t *energy) {
+    memset(energy, 0, sizeof(*energy));
+    int denied = 0;
+    add_rapl_zones(energy, &denied);
+    if (energy->count == 0) {
+        add_amd_energy(energy, &denied);
+    }
+    if (energy->count > 0) {
+        return 0;
+    }
+    if (denied > 0) {
+        ms_set_error(ctx, "Energy counters not readable, need root or CAP_SYS_ADMIN "
+            "(energy_uj is 0400 since Linux 5.10)");
+    } else {
+        ms_set_error(ctx, "No RAPL or amd_energy counters under /sys/class/powercap or /sys/class/hwmon");
+    }
+    return -1;
+}
+
+
+void ms_energy_start(ms_energy_t *energy) {
+    if (energy == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < energy->count; i++) {
+        ms_energy_domain_t *d = &energy->domains[i];
+        d->joules = 0;
+        if (read_u64(d->path, &d->start_uj) != 0) {
+            d->start_uj = UINT64_MAX;
+        }
+    }
+}
+
+
+// A counter wraps at max_uj, every few minutes for a busy package, so runs
+// longer than one range under-report.  Without a known range a wrap is
+// unreadable.
+void ms_energy_stop(ms_energy_t *energy) {
+    if (energy == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < energy->count; i++) {
+        ms_energy_domain_t *d = &energy->domains[i];
+        uint64_t end_uj;
+        if (d->start_uj == UINT64_MAX || read_u64(d->path, &end_uj) != 0) {
+            d->joules = -1;
+            continue;
+        }
+        if (end_uj < d->start_uj && d->max_uj == 0) {
+            d->joules = -1;
+            continue;
+        }
+        uint64_t used = end_uj >= d->start_uj ? end_uj - d->start_uj : d->max_uj - d->start_uj + end_uj;
+        d->joules = used / 1e6;
+    }
+}
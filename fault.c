@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+typedef struct fault_worker {
+    ms_ctx_t *ctx;
+    ms_buffer_t buf;
+    ms_fault_test_t test;
+    size_t rounds;
+    double time;
+    char error[sizeof(((ms_ctx_t*) 0)->error)];
+} fault_worker_t;
+
+
+static const char *fault_test_names[] = {
+    [MS_FAULT_TOUCH] = "touch",
+    [MS_FAULT_POPULATE] = "populate",
+    [MS_FAULT_REFAULT] = "refault",
+    [MS_FAULT_MUNMAP] = "munmap",
+};
+
+
+const char *ms_fault_test_name(ms_fault_test_t test) {
+    return fault_test_names[test];
+}
+
+
+// Every base page is written, even for huge pages, so a THP mapping that
+// fell back to base pages is still fully faulted.
+static void touch(void *mem, size_t size, size_t page_size) {
+    for (size_t i = 0; i < size; i += page_size) {
+        ((volatile char*) mem)[i] = 1;
+    }
+}
+
+
+static void fault_worker_run(void *arg) {
+    fault_worker_t *w = arg;
+    ms_ctx_t *ctx = w->ctx;
+    ms_buffer_t *buf = &w->buf;
+    ms_ctx_t local;
+    ms_ctx_init(&local);
+    double t;
+    if (w->test == MS_FAULT_REFAULT) {
+        if (ms_alloc(&local, buf) != 0) {
+            goto fail;
+        }
+        touch(buf->mem, buf->size, ctx->page_size);
+    }
+    for (size_t round = 0; round < w->rounds; round++) {
+        switch (w->test) {
+        case MS_FAULT_TOUCH:
+            if (ms_alloc(&local, buf) != 0) {
+                goto fail;
+            }
+            t = ms_time();
+            touch(buf->mem, buf->size, ctx->page_size);
+            w->time += ms_time() - t;
+            ms_dealloc(buf);
+            break;
+        case MS_FAULT_POPULATE:
+            t = ms_time();
+            if (ms_alloc(&local, buf) != 0) {
+                goto fail;
+            }
+            w->time += ms_time() - t;
+            ms_dealloc(buf);
+            break;
+        case MS_FAULT_REFAULT:
+            t = ms_time();
+            if (madvise(buf->mem, buf->size, MADV_DONTNEED) != 0) {
+                ms_set_error(&local, "madvise(MADV_DONTNEED) failed: %s", strerror(errno));
+                goto fail;
+            }
+            touch(buf->mem, buf->size, ctx->page_size);
+            w->time += ms_time() - t;
+            break;
+        case MS_FAULT_MUNMAP:
+            if (ms_alloc(&local, buf) != 0) {
+                goto fail;
+            }
+            touch(buf->mem, buf->size, ctx->page_size);
+            t = ms_time();
+            ms_dealloc(buf);
+            w->time += ms_time() - t;
+            break;
+        default:
+            ms_set_error(&local, "Invalid fault test");
+            goto fail;
+        }
+    }
+fail:
+    ms_dealloc(buf);
+    memcpy(w->error, local.error, sizeof(w->error));
+    ms_ctx_destroy(&local);
+}
+
+
+int ms_fault_bench(ms_ctx_t *ctx, const ms_buffer_t *buf, ms_fault_test_t test, size_t rounds,
+                   ms_fault_result_t *result) {
+    if (buf->size < 1 || rounds < 1 || test >= MS_FAULT_TESTS) {
+        ms_set_error(ctx, "Invalid fault bench args");
+        return -1;
+    }
+    if (test == MS_FAULT_POPULATE && buf->source == MS_SOURCE_MALLOC) {
+        ms_set_error(ctx, "populate needs an mmap buffer source");
+        return -1;
+    }
+    fault_worker_t *workers = calloc(ctx->threads, sizeof(fault_worker_t));
+    if (workers == NULL) {
+        ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        return -1;
+    }
+    for (size_t i = 0; i < ctx->threads; i++) {
+        workers[i].ctx = ctx;
+        workers[i].buf = *buf;
+        workers[i].buf.populate = test == MS_FAULT_POPULATE;
+        workers[i].test = test;
+        workers[i].rounds = rounds;
+    }
+    int ret = ms_run_pinned(ctx, fault_worker_run, workers, sizeof(fault_worker_t));
+    memset(result, 0, sizeof(*result));
+    result->page_size = buf->pages == MS_PAGES_BASE ? ctx->page_size : ms_huge_page_size();
+    const size_t pages = buf->size / result->page_size * rounds;
+    for (size_t i = 0; i < ctx->threads && ret == 0; i++) {
+        if (workers[i].error[0]) {
+            ms_set_error(ctx, "Thread %zu: %s", i, workers[i].error);
+            ret = -1;
+            break;
+        }
+        result->pages += pages;
+        result->thread_rate += pages / workers[i].time / ctx->threads;
+        result->time = MAX(result->time, workers[i].time);
+    }
+    free(workers);
+    return ret;
+}
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+# include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+// Index counts are kept a multiple of this so no kernel needs a tail loop.
+#define INDEX_ALIGN 16
+
+// vpgatherdq / vpscatterdq sign extend their 32bit indices.
+#define INDEX_UNSIGNED_MAX ((size_t) UINT32_MAX + 1)
+#define INDEX_SIGNED_MAX ((size_t) INT32_MAX + 1)
+
+
+static uint64_t gather_scalar(const uint64_t *table, const uint32_t *idx, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += table[idx[i]];
+    }
+    return sum;
+}
+
+
+static void scatter_scalar(uint64_t *table, const uint32_t *idx, size_t n, uint64_t v) {
+    for (size_t i = 0; i < n; i++) {
+        table[idx[i]] = v;
+    }
+}
+
+
+// Independent accumulators, so loads are not serialized behind one add chain.
+static uint64_t gather_scalar_x4(const uint64_t *table, const uint32_t *idx, size_t n) {
+    uint64_t a = 0, b = 0, c = 0, d = 0;
+    for (size_t i = 0; i < n; i += 4) {
+        a += table[idx[i]];
+        b += table[idx[i + 1]];
+        c += table[idx[i + 2]];
+        d += table[idx[i + 3]];
+    }
+    return a + b + c + d;
+}
+
+
+static void scatter_scalar_x4(uint64_t *table, const uint32_t *idx, size_t n, uint64_t v) {
+    for (size_t i = 0; i < n; i += 4) {
+        table[idx[i]] = v;
+        table[idx[i + 1]] = v;
+        table[idx[i + 2]] = v;
+        table[idx[i + 3]] = v;
+    }
+}
+
+
+#ifdef __AVX2__
+static uint64_t gather_avx2(const uint64_t *table, const uint32_t *idx, size_t n) {
+    const long long *base = (const long long*) table;
+    __m256i a = _mm256_setzero_si256();
+    __m256i b = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += 8) {
+        __m128i ia = _mm_loadu_si128((const __m128i*) (idx + i));
+        __m128i ib = _mm_loadu_si128((const __m128i*) (idx + i + 4));
+        a = _mm256_add_epi64(a, _mm256_i32gather_epi64(base, ia, 8));
+        b = _mm256_add_epi64(b, _mm256_i32gather_epi64(base, ib, 8));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*) lanes, _mm256_add_epi64(a, b));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+
+# ifdef __AVX512F__
+static uint64_t gather_avx512(const uint64_t *table, const uint32_t *idx, size_t n) {
+    __m512i a = _mm512_setzero_si512();
+    __m512i b = _mm512_setzero_si512();
+    for (size_t i = 0; i < n; i += 16) {
+        __m256i ia = _mm256_loadu_si256((const __m256i*) (idx + i));
+        __m256i ib = _mm256_loadu_si256((const __m256i*) (idx + i + 8));
+        a = _mm512_add_epi64(a, _mm512_i32gather_epi64(ia, table, 8));
+        b = _mm512_add_epi64(b, _mm512_i32gather_epi64(ib, table, 8));
+    }
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(a, b));
+}
+
+
+static void scatter_avx512(uint64_t *table, const uint32_t *idx, size_t n, uint64_t v) {
+    const __m512i vec = _mm512_set1_epi64(v);
+    for (size_t i = 0; i < n; i += 8) {
+        __m256i vi = _mm256_loadu_si256((const __m256i*) (idx + i));
+        _mm512_i32scatter_epi64(table, vi, vec, 8);
+    }
+}
+# endif  // avx512
+#endif  // avx2
+
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+// NEON has no gather; indices come in as a vector and lanes are filled with
+// scalar loads, the shape compilers emit for SVE-less targets.
+static uint64_t gather_neon(const uint64_t *table, const uint32_t *idx, size_t n) {
+    uint64x2_t a = vdupq_n_u64(0);
+    uint64x2_t b = vdupq_n_u64(0);
+    for (size_t i = 0; i < n; i += 4) {
+        uint32x4_t vi = vld1q_u32(idx + i);
+        uint64x2_t x = vdupq_n_u64(table[vgetq_lane_u32(vi, 0)]);
+        uint64x2_t y = vdupq_n_u64(table[vgetq_lane_u32(vi, 2)]);
+        x = vsetq_lane_u64(table[vgetq_lane_u32(vi, 1)], x, 1);
+        y = vsetq_lane_u64(table[vgetq_lane_u32(vi, 3)], y, 1);
+        a = vaddq_u64(a, x);
+        b = vaddq_u64(b, y);
+    }
+    return vaddvq_u64(vaddq_u64(a, b));
+}
+#endif
+
+
+static const ms_index_impl_t index_impls[] = {
+    {"scalar", "C loop", gather_scalar, scatter_scalar, INDEX_UNSIGNED_MAX},
+    {"scalar_x4", "C loop, 4 independent accesses", gather_scalar_x4, scatter_scalar_x4, INDEX_UNSIGNED_MAX},
+#ifdef __AVX2__
+    {"avx2", "AVX2 vpgatherdq, no scatter", gather_avx2, NULL, INDEX_SIGNED_MAX},
+# ifdef __AVX512F__
+    {"avx512", "AVX512 vpgatherdq / vpscatterdq", gather_avx512, scatter_avx512, INDEX_SIGNED_MAX},
+# endif
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    {"neon", "NEON index loads, lane by lane fills, no scatter", gather_neon, NULL, INDEX_UNSIGNED_MAX},
+#endif
+    {NULL, NULL, NULL, NULL, 0}
+};
+
+
+static const char *index_pattern_names[] = {
+    [MS_INDEX_SEQUENTIAL] = "sequential",
+    [MS_INDEX_CLUSTERED] = "clustered",
+    [MS_INDEX_RANDOM] = "random",
+};
+
+
+const ms_index_impl_t *ms_index_impls(void) {
+    return index_impls;
+}
+
+
+const char *ms_index_pattern_name(ms_index_pattern_t pattern) {
+    return index_pattern_names[pattern];
+}
+
+
+int ms_index_init(ms_ctx_t *ctx, ms_index_t *index, ms_index_pattern_t pattern, size_t elements,
+                  size_t count) {
+    memset(index, 0, sizeof(*index));
+    const size_t per_line = MS_CACHE_LINE / sizeof(uint64_t);
+    if (elements < per_line || elements > INDEX_UNSIGNED_MAX || count < INDEX_ALIGN ||
+        count % INDEX_ALIGN) {
+        ms_set_error(ctx, "Invalid index table size");
+        return -1;
+    }
+    uint32_t *idx = malloc(count * sizeof(uint32_t));
+    if (idx == NULL) {
+        ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        return -1;
+    }
+    uint64_t rng = 0x9e3779b97f4a7c15;
+    const size_t lines = elements / per_line;
+    size_t line = 0;
+    for (size_t i = 0; i < count; i++) {
+        switch (pattern) {
+        case MS_INDEX_SEQUENTIAL:
+            idx[i] = i % elements;
+            break;
+        case MS_INDEX_CLUSTERED:
+            if (i % per_line == 0) {
+                line = ms_xorshift64(&rng) % lines;
+            }
+            idx[i] = line * per_line + i % per_line;
+            break;
+        default:
+            idx[i] = ms_xorshift64(&rng) % elements;
+            break;
+        }
+    }
+    index->idx = idx;
+    index->count = count;
+    index->elements = elements;
+    return 0;
+}
+
+
+void ms_index_destroy(ms_index_t *index) {
+    free(index->idx);
+    index->idx = NULL;
+}
+
+
+int ms_index_bench(ms_ctx_t *ctx, const ms_index_impl_t *impl, bool scatter, uint64_t *table,
+                   const ms_index_t *index, size_t min_elements, ms_index_result_t *result) {
+    if (scatter && impl->scatter == NULL) {
+        ms_set_error(ctx, "%s has no scatter", impl->name);
+        return -1;
+    }
+    if (index->elements > impl->max_elements) {
+        ms_set_error(ctx, "%s indices reach %zu elements (vector gathers sign extend 32bit indices), "
+            "the table has %zu", impl->name, impl->max_elements, index->elements);
+        return -1;
+    }
+    volatile uint64_t sink = 0;
+    const size_t passes = MAX(min_elements / index->count, 2);
+    // Warm up caches and TLBs
+    if (scatter) {
+        impl->scatter(table, index->idx, index->count, 0);
+    } else {
+        sink += impl->gather(table, index->idx, index->count);
+    }
+    ctx->start_time = ms_time();
+    for (size_t p = 1; p <= passes; p++) {
+        if (scatter) {
+            impl->scatter(table, index->idx, index->count, p);
+            __asm__ __volatile__("" ::: "memory");
+        } else {
+            sink += impl->gather(table, index->idx, index->count);
+        }
+    }
+    ctx->end_time = ms_time();
+    (void) sink;
+    result->elements = passes * index->count;
+    result->time = ctx->end_time - ctx->start_time;
+    return 0;
+}
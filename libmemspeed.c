@@ -0,0 +1,1885 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+# include <sys/prctl.h>
+#endif
+#if defined(__AVX2__) || defined(__AVX512F__)
+# include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+#ifdef __x86_64__
+# include <cpuid.h>
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+# include <sys/auxv.h>
+# ifndef HWCAP_DCPOP
+#  define HWCAP_DCPOP (1 << 16)
+# endif
+#endif
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+typedef struct thread_options {
+    int id;
+    ms_ctx_t *ctx;
+    ms_write_test test;
+    ms_strided_test strided;    // NULL calls test once per block
+    void *mem;
+    size_t size;                // Bytes per shard pass, or per chunk
+    size_t block;               // Bytes per kernel call, the whole shard unless interleaved
+    size_t stride;              // Distance between this worker's blocks
+    size_t iterations;
+    size_t chunk_size;          // MS_SCHED_CHUNKED
+    size_t buffer_chunks;
+    atomic_size_t *next_chunk;
+    size_t chunks;
+    double time;
+    int err;
+    size_t *ready;
+    size_t *done;
+    bool *started;
+    pthread_cond_t *ready_cond;
+    pthread_mutex_t *ready_mut;
+    pthread_cond_t *start_cond;
+    pthread_mutex_t *start_mut;
+    pthread_cond_t *prog_cond;
+    pthread_mutex_t *prog_mut;
+} thread_options_t;
+
+typedef struct pinned_worker {
+    void (*fn)(void *arg);
+    void *arg;
+    bool *started;
+    pthread_cond_t *start_cond;
+    pthread_mutex_t *start_mut;
+} pinned_worker_t;
+
+typedef struct cpus_topology {
+    int *cpus;
+    int count;
+} cpus_topology_t;
+
+
+// The page size never changes for the life of the process, so it is safe to
+// share with the kernels, which only receive a pointer, size and iteration.
+static size_t g_page_size = 0;
+
+
+// pthread calls return the error number rather than setting errno.
+#define ZERO_OR_FAIL(ctx, call) \
+    do { \
+        int _rc = (call); \
+        if (_rc != 0) { \
+            ms_set_error(ctx, "%s: %s", #call, strerror(_rc)); \
+            goto fail; \
+        } \
+    } while (0)
+
+// Workers only record the failure; the coordinator reports it after joining.
+#define WORKER_ZERO_OR_FAIL(options, call) \
+    do { \
+        int _rc = (call); \
+        if (_rc != 0) { \
+            (options)->err = _rc; \
+            goto fail; \
+        } \
+    } while (0)
+
+
+void ms_set_error(ms_ctx_t *ctx, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(ctx->error, sizeof(ctx->error), fmt, args);
+    va_end(args);
+}
+
+
+void ms_log(ms_ctx_t *ctx, const char *fmt, ...) {
+    if (ctx->log == NULL) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(ctx->log, fmt, args);
+    va_end(args);
+}
+
+
+int ms_ctx_init(ms_ctx_t *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size < 1) {
+        ms_set_error(ctx, "Page size unavailable: %s", strerror(errno));
+        return -1;
+    }
+    g_page_size = page_size;
+    ctx->page_size = page_size;
+    ctx->threads = 1;
+    atomic_init(&ctx->stop, false);
+    return 0;
+}
+
+
+void ms_ctx_destroy(ms_ctx_t *ctx) {
+    free(ctx->thread_cpus);
+    ctx->thread_cpus = NULL;
+    free(ctx->thread_chunks);
+    ctx->thread_chunks = NULL;
+    free(ctx->thread_times);
+    ctx->thread_times = NULL;
+}
+
+
+const char *ms_error(const ms_ctx_t *ctx) {
+    return ctx->error;
+}
+
+
+double ms_time(void) {
+    struct timespec tspec;
+    // Only fails for an invalid clock id or pointer.
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return tspec.tv_sec + tspec.tv_nsec / 1e9;
+}
+
+
+uint64_t ms_ticks(void) {
+#if defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (ticks) :: "memory");
+    return ticks;
+#else
+    return 0;
+#endif
+}
+
+
+size_t ms_batch_passes(const ms_ctx_t *ctx, size_t size) {
+    if (ctx->batch > 0) {
+        return ctx->batch;
+    }
+    return MAX(MS_BATCH_BYTES / size, 1);
+}
+
+
+static const char *source_names[] = {
+    [MS_SOURCE_MALLOC] = "malloc",
+    [MS_SOURCE_PRIVATE] = "private",
+    [MS_SOURCE_SHARED] = "shared",
+    [MS_SOURCE_MEMFD] = "memfd",
+    [MS_SOURCE_FILE] = "file",
+};
+
+
+const char *ms_source_name(ms_source_t source) {
+    return source_names[source];
+}
+
+
+int ms_source_parse(const char *name, ms_source_t *source) {
+    for (size_t i = 0; i < sizeof(source_names) / sizeof(source_names[0]); i++) {
+        if (strcmp(source_names[i], name) == 0) {
+            *source = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+static const char *sched_names[] = {
+    [MS_SCHED_STATIC] = "static",
+    [MS_SCHED_CHUNKED] = "chunked",
+};
+
+
+const char *ms_sched_name(ms_sched_t sched) {
+    return sched_names[sched];
+}
+
+
+int ms_sched_parse(const char *name, ms_sched_t *sched) {
+    for (size_t i = 0; i < sizeof(sched_names) / sizeof(sched_names[0]); i++) {
+        if (strcmp(sched_names[i], name) == 0) {
+            *sched = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+size_t ms_chunk_size(const ms_ctx_t *ctx, size_t buffer_size) {
+    if (ctx->chunk_size > 0) {
+        return ctx->chunk_size;
+    }
+    return MIN(MS_CHUNK_SIZE, buffer_size / MAX(ctx->threads, 1));
+}
+
+
+static const char *layout_names[] = {
+    [MS_LAYOUT_CONTIGUOUS] = "contiguous",
+    [MS_LAYOUT_LINE] = "line",
+    [MS_LAYOUT_PAGE] = "page",
+    [MS_LAYOUT_BLOCK] = "block",
+};
+
+
+const char *ms_layout_name(ms_layout_t layout) {
+    return layout_names[layout];
+}
+
+
+int ms_layout_parse(const char *name, ms_layout_t *layout) {
+    for (size_t i = 0; i < sizeof(layout_names) / sizeof(layout_names[0]); i++) {
+        if (strcmp(layout_names[i], name) == 0) {
+            *layout = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+size_t ms_layout_block(const ms_ctx_t *ctx, size_t shard_size) {
+    switch (ctx->layout) {
+    case MS_LAYOUT_LINE:
+        return MS_CACHE_LINE;
+    case MS_LAYOUT_PAGE:
+        return ctx->page_size;
+    case MS_LAYOUT_BLOCK:
+        return ctx->block_size;
+    default:
+        return shard_size;
+    }
+}
+
+
+static const char *pages_names[] = {
+    [MS_PAGES_BASE] = "base",
+    [MS_PAGES_THP] = "thp",
+    [MS_PAGES_HUGETLB] = "hugetlb",
+};
+
+
+const char *ms_pages_name(ms_pages_t pages) {
+    return pages_names[pages];
+}
+
+
+int ms_pages_parse(const char *name, ms_pages_t *pages) {
+    for (size_t i = 0; i < sizeof(pages_names) / sizeof(pages_names[0]); i++) {
+        if (strcmp(pages_names[i], name) == 0) {
+            *pages = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+size_t ms_huge_page_size(void) {
+    size_t size = 2 * MS_MB;
+#ifdef __linux__
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%zu", &size) != 1) {
+            size = 2 * MS_MB;
+        }
+        fclose(f);
+    }
+#endif
+    return size;
+}
+
+
+// A directory gets an unlinked temp file so nothing is left behind on tmpfs
+// or hugetlbfs mounts; anything else is opened (or created) as is.
+static int open_backing_file(ms_ctx_t *ctx, ms_buffer_t *buf) {
+    struct stat st;
+    int fd;
+    if (stat(buf->path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        char tmpl[4096];
+        snprintf(tmpl, sizeof(tmpl), "%s/memspeed-XXXXXX", buf->path);
+        fd = mkstemp(tmpl);
+        if (fd != -1) {
+            unlink(tmpl);
+        }
+    } else {
+        fd = open(buf->path, O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+    }
+    if (fd == -1) {
+        ms_set_error(ctx, "Open %s failed: %s", buf->path, strerror(errno));
+    }
+    return fd;
+}
+
+
+// THP must be requested before the first fault, so THP mappings populate
+// here instead of with MAP_POPULATE.
+static int advise_pages(ms_ctx_t *ctx, ms_buffer_t *buf) {
+    if (buf->pages != MS_PAGES_THP) {
+        return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    if (madvise(buf->mem, buf->size, MADV_HUGEPAGE) != 0) {
+        ms_set_error(ctx, "madvise(MADV_HUGEPAGE) failed: %s", strerror(errno));
+        ms_dealloc(buf);
+        return -1;
+    }
+#else
+    ms_set_error(ctx, "THP is not supported on this platform");
+    ms_dealloc(buf);
+    return -1;
+#endif
+    if (buf->populate) {
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(buf->mem, buf->size, MADV_POPULATE_WRITE) == 0) {
+            return 0;
+        }
+#endif
+        // Pre 5.14 kernels, touch each page instead.
+        for (size_t i = 0; i < buf->size; i += ctx->page_size) {
+            ((volatile char*) buf->mem)[i] = 0;
+        }
+    }
+    return 0;
+}
+
+
+int ms_alloc(ms_ctx_t *ctx, ms_buffer_t *buf) {
+    int flags = MAP_SHARED;
+    buf->fd = -1;
+    buf->mem = NULL;
+    switch (buf->source) {
+    case MS_SOURCE_MALLOC:
+        if (buf->pages == MS_PAGES_HUGETLB || buf->populate) {
+            ms_set_error(ctx, "malloc source does not support hugetlb pages or populate");
+            return -1;
+        }
+        buf->mem = aligned_alloc(buf->pages == MS_PAGES_THP ? ms_huge_page_size() : ctx->page_size,
+                                 buf->size);
+        if (buf->mem == NULL) {
+            ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+            return -1;
+        }
+        return advise_pages(ctx, buf);
+    case MS_SOURCE_PRIVATE:
+        flags = MAP_PRIVATE|MAP_ANONYMOUS;
+        break;
+    case MS_SOURCE_SHARED:
+        flags = MAP_SHARED|MAP_ANONYMOUS;
+        break;
+    case MS_SOURCE_MEMFD:
+#ifdef __linux__
+        buf->fd = memfd_create("memspeed", MFD_CLOEXEC |
+                               (buf->pages == MS_PAGES_HUGETLB ? MFD_HUGETLB : 0));
+        if (buf->fd == -1) {
+            ms_set_error(ctx, "memfd_create failed: %s", strerror(errno));
+            return -1;
+        }
+        break;
+#else
+        ms_set_error(ctx, "memfd is not supported on this platform");
+        return -1;
+#endif
+    case MS_SOURCE_FILE:
+        if (buf->path == NULL) {
+            ms_set_error(ctx, "File source requires a path");
+            return -1;
+        }
+        buf->fd = open_backing_file(ctx, buf);
+        if (buf->fd == -1) {
+            return -1;
+        }
+        if (buf->map_sync) {
+#ifdef MAP_SYNC
+            flags = MAP_SHARED_VALIDATE|MAP_SYNC;
+#else
+            ms_set_error(ctx, "MAP_SYNC is not supported on this platform");
+            close(buf->fd);
+            return -1;
+#endif
+        }
+        break;
+    default:
+        ms_set_error(ctx, "Invalid buffer source");
+        return -1;
+    }
+    if (buf->pages == MS_PAGES_HUGETLB && (flags & MAP_ANONYMOUS)) {
+#ifdef MAP_HUGETLB
+        flags |= MAP_HUGETLB;
+#else
+        ms_set_error(ctx, "hugetlb pages are not supported on this platform");
+        return -1;
+#endif
+    }
+    if (buf->populate && buf->pages != MS_PAGES_THP) {
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#else
+        ms_set_error(ctx, "MAP_POPULATE is not supported on this platform");
+        if (buf->fd != -1) {
+            close(buf->fd);
+        }
+        return -1;
+#endif
+    }
+    if (buf->fd != -1 && ftruncate(buf->fd, buf->size) != 0) {
+        ms_set_error(ctx, "Resize of backing file failed: %s", strerror(errno));
+        close(buf->fd);
+        return -1;
+    }
+    void *ptr = mmap(NULL, buf->size, PROT_READ|PROT_WRITE, flags, buf->fd, 0);
+    if (ptr == MAP_FAILED) {
+        if (buf->map_sync && errno == EOPNOTSUPP) {
+            ms_set_error(ctx, "MAP_SYNC requires a DAX capable filesystem");
+        } else {
+            ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        }
+        if (buf->fd != -1) {
+            close(buf->fd);
+        }
+        return -1;
+    }
+    buf->mem = ptr;
+    return advise_pages(ctx, buf);
+}
+
+
+void ms_dealloc(ms_buffer_t *buf) {
+    if (buf->mem == NULL) {
+        return;
+    }
+    if (buf->source == MS_SOURCE_MALLOC) {
+        free(buf->mem);
+    } else {
+        munmap(buf->mem, buf->size);
+    }
+    if (buf->fd != -1) {
+        close(buf->fd);
+    }
+    buf->mem = NULL;
+    buf->fd = -1;
+}
+
+
+int ms_sync(ms_ctx_t *ctx, ms_buffer_t *buf, double *msync_time, double *fdatasync_time) {
+    if (buf->fd == -1) {
+        ms_set_error(ctx, "Buffer source %s has no backing file", ms_source_name(buf->source));
+        return -1;
+    }
+    double t = ms_time();
+    if (msync(buf->mem, buf->size, MS_SYNC) != 0) {
+        ms_set_error(ctx, "msync failed: %s", strerror(errno));
+        return -1;
+    }
+    *msync_time = ms_time() - t;
+    t = ms_time();
+    if (fdatasync(buf->fd) != 0) {
+        ms_set_error(ctx, "fdatasync failed: %s", strerror(errno));
+        return -1;
+    }
+    *fdatasync_time = ms_time() - t;
+    return 0;
+}
+
+
+void ms_prefault(void *mem, size_t size) {
+    // NOTE: Memset can get optimized out, must write by hand...
+    for (size_t i = 0; i < size; i++) {
+        ((volatile char*) mem)[i] = 0b01010101;
+        (void) ((volatile char*) mem)[i];
+    }
+}
+
+
+#ifdef __x86_64__
+static void mem_write_test_x86asm_nt(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t);
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "movq %[mem], %%rdx\n\t"
+        "movq %[len], %%rcx\n\t"
+    "1:\n\t"
+        "movnti %[v], (%%rdx)\n\t"
+        "addq $8, %%rdx\n\t"
+        "dec %%rcx\n\t"
+        "jnz 1b\n\t"
+        "sfence\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "rcx", "rdx", "memory"
+    );
+}
+
+
+static void mem_write_test_x86asm(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t);
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "movq %[mem], %%rdx\n\t"
+        "movq %[len], %%rcx\n\t"
+    "1:\n\t"
+        "movq %[v], (%%rdx)\n\t"
+        "addq $8, %%rdx\n\t"
+        "dec %%rcx\n\t"
+        "jnz 1b\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "rcx", "rdx", "memory"
+    );
+}
+
+
+static void mem_write_test_x86asm_nt_x8(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t) / 8;
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "movq %[mem], %%rdx\n\t"
+        "movq %[len], %%rcx\n\t"
+    "1:\n\t"
+        "movnti %[v], (%%rdx)\n\t"
+        "movnti %[v], 8(%%rdx)\n\t"
+        "movnti %[v], 16(%%rdx)\n\t"
+        "movnti %[v], 24(%%rdx)\n\t"
+        "movnti %[v], 32(%%rdx)\n\t"
+        "movnti %[v], 40(%%rdx)\n\t"
+        "movnti %[v], 48(%%rdx)\n\t"
+        "movnti %[v], 56(%%rdx)\n\t"
+        "addq $64, %%rdx\n\t"
+        "dec %%rcx\n\t"
+        "jnz 1b\n\t"
+        "sfence\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "rcx", "rdx", "memory"
+    );
+}
+
+
+static void mem_write_test_x86asm_x8(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t) / 8;
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "movq %[mem], %%rdx\n\t"
+        "movq %[len], %%rcx\n\t"
+    "1:\n\t"
+        "movq %[v], (%%rdx)\n\t"
+        "movq %[v], 8(%%rdx)\n\t"
+        "movq %[v], 16(%%rdx)\n\t"
+        "movq %[v], 24(%%rdx)\n\t"
+        "movq %[v], 32(%%rdx)\n\t"
+        "movq %[v], 40(%%rdx)\n\t"
+        "movq %[v], 48(%%rdx)\n\t"
+        "movq %[v], 56(%%rdx)\n\t"
+        "addq $64, %%rdx\n\t"
+        "dec %%rcx\n\t"
+        "jnz 1b\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "rcx", "rdx", "memory"
+    );
+}
+
+
+static void mem_write_test_x86asm_nt_x32(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t) / 32;
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "movq %[mem], %%rdx\n\t"
+        "movq %[len], %%rcx\n\t"
+    "1:\n\t"
+        "movnti %[v], (%%rdx)\n\t"
+        "movnti %[v], 8(%%rdx)\n\t"
+        "movnti %[v], 16(%%rdx)\n\t"
+        "movnti %[v], 24(%%rdx)\n\t"
+        "movnti %[v], 32(%%rdx)\n\t"
+        "movnti %[v], 40(%%rdx)\n\t"
+        "movnti %[v], 48(%%rdx)\n\t"
+        "movnti %[v], 56(%%rdx)\n\t"
+        "movnti %[v], 64(%%rdx)\n\t"
+        "movnti %[v], 72(%%rdx)\n\t"
+        "movnti %[v], 80(%%rdx)\n\t"
+        "movnti %[v], 88(%%rdx)\n\t"
+        "movnti %[v], 96(%%rdx)\n\t"
+        "movnti %[v], 104(%%rdx)\n\t"
+        "movnti %[v], 112(%%rdx)\n\t"
+        "movnti %[v], 120(%%rdx)\n\t"
+        "movnti %[v], 128(%%rdx)\n\t"
+        "movnti %[v], 136(%%rdx)\n\t"
+        "movnti %[v], 144(%%rdx)\n\t"
+        "movnti %[v], 152(%%rdx)\n\t"
+        "movnti %[v], 160(%%rdx)\n\t"
+        "movnti %[v], 168(%%rdx)\n\t"
+        "movnti %[v], 176(%%rdx)\n\t"
+        "movnti %[v], 184(%%rdx)\n\t"
+        "movnti %[v], 192(%%rdx)\n\t"
+        "movnti %[v], 200(%%rdx)\n\t"
+        "movnti %[v], 208(%%rdx)\n\t"
+        "movnti %[v], 216(%%rdx)\n\t"
+        "movnti %[v], 224(%%rdx)\n\t"
+        "movnti %[v], 232(%%rdx)\n\t"
+        "movnti %[v], 240(%%rdx)\n\t"
+        "movnti %[v], 248(%%rdx)\n\t"
+        "addq $256, %%rdx\n\t"
+        "dec %%rcx\n\t"
+        "jnz 1b\n\t"
+        "sfence\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "rcx", "rdx", "memory"
+    );
+}
+
+
+static void mem_write_test_x86asm_x32(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t) / 32;
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "movq %[mem], %%rdx\n\t"
+        "movq %[len], %%rcx\n\t"
+    "1:\n\t"
+        "movq %[v], (%%rdx)\n\t"
+        "movq %[v], 8(%%rdx)\n\t"
+        "movq %[v], 16(%%rdx)\n\t"
+        "movq %[v], 24(%%rdx)\n\t"
+        "movq %[v], 32(%%rdx)\n\t"
+        "movq %[v], 40(%%rdx)\n\t"
+        "movq %[v], 48(%%rdx)\n\t"
+        "movq %[v], 56(%%rdx)\n\t"
+        "movq %[v], 64(%%rdx)\n\t"
+        "movq %[v], 72(%%rdx)\n\t"
+        "movq %[v], 80(%%rdx)\n\t"
+        "movq %[v], 88(%%rdx)\n\t"
+        "movq %[v], 96(%%rdx)\n\t"
+        "movq %[v], 104(%%rdx)\n\t"
+        "movq %[v], 112(%%rdx)\n\t"
+        "movq %[v], 120(%%rdx)\n\t"
+        "movq %[v], 128(%%rdx)\n\t"
+        "movq %[v], 136(%%rdx)\n\t"
+        "movq %[v], 144(%%rdx)\n\t"
+        "movq %[v], 152(%%rdx)\n\t"
+        "movq %[v], 160(%%rdx)\n\t"
+        "movq %[v], 168(%%rdx)\n\t"
+        "movq %[v], 176(%%rdx)\n\t"
+        "movq %[v], 184(%%rdx)\n\t"
+        "movq %[v], 192(%%rdx)\n\t"
+        "movq %[v], 200(%%rdx)\n\t"
+        "movq %[v], 208(%%rdx)\n\t"
+        "movq %[v], 216(%%rdx)\n\t"
+        "movq %[v], 224(%%rdx)\n\t"
+        "movq %[v], 232(%%rdx)\n\t"
+        "movq %[v], 240(%%rdx)\n\t"
+        "movq %[v], 248(%%rdx)\n\t"
+        "addq $256, %%rdx\n\t"
+        "dec %%rcx\n\t"
+        "jnz 1b\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "rcx", "rdx", "memory"
+    );
+}
+#endif  // x86_64
+
+
+#ifdef __AVX2__
+static void mem_write_test_avx2_nt(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    const __m256i vec = _mm256_set1_epi64x(v);
+    __m256i *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(__m256i); i++) {
+         _mm256_stream_si256(mem + i, vec);
+    }
+    _mm_sfence();
+}
+
+
+static void mem_write_test_avx2(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    const __m256i vec = _mm256_set1_epi64x(v);
+    __m256i *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(__m256i); i++) {
+         _mm256_store_si256(mem + i, vec);
+    }
+}
+
+
+static void mem_write_test_avx2_u(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    const __m256i vec = _mm256_set1_epi64x(v);
+    char *mem = ptr;
+    for (size_t i = 0; i + sizeof(__m256i) <= size; i += sizeof(__m256i)) {
+         _mm256_storeu_si256((__m256i*) (mem + i), vec);
+    }
+}
+
+
+# ifdef __AVX512F__
+static void mem_write_test_avx512_nt(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    const __m512i vec = _mm512_set1_epi64(v);
+    __m512i *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(__m512i); i++) {
+         _mm512_stream_si512(mem + i, vec);
+    }
+    _mm_sfence();
+}
+
+
+static void mem_write_test_avx512(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    const __m512i vec = _mm512_set1_epi64(v);
+    __m512i *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(__m512i); i++) {
+         _mm512_store_si512(mem + i, vec);
+    }
+}
+
+
+static void mem_write_test_avx512_u(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    const __m512i vec = _mm512_set1_epi64(v);
+    char *mem = ptr;
+    for (size_t i = 0; i + sizeof(__m512i) <= size; i += sizeof(__m512i)) {
+         _mm512_storeu_si512(mem + i, vec);
+    }
+}
+# endif  // avx512
+#endif  // avx2
+
+
+#ifdef __aarch64__
+static void mem_write_test_armasm(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t);
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "mov x0, %[mem]\n\t"
+        "mov x1, %[len]\n\t"
+    "1: \n\t"
+        "stp %[v], %[v], [x0]\n\t"
+        "add x0, x0, #16\n\t"
+        "subs x1, x1, #2\n\t"
+        "b.gt 1b\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "x0", "x1", "memory"
+    );
+}
+
+
+static void mem_write_test_armasm_x8(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t);
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "mov x0, %[mem]\n\t"
+        "mov x1, %[len]\n\t"
+    "1: \n\t"
+        "stp %[v], %[v], [x0]\n\t"
+        "stp %[v], %[v], [x0, #16]\n\t"
+        "stp %[v], %[v], [x0, #32]\n\t"
+        "stp %[v], %[v], [x0, #48]\n\t"
+        "stp %[v], %[v], [x0, #64]\n\t"
+        "stp %[v], %[v], [x0, #80]\n\t"
+        "stp %[v], %[v], [x0, #96]\n\t"
+        "stp %[v], %[v], [x0, #112]\n\t"
+        "add x0, x0, #128\n\t"
+        "subs x1, x1, #16\n\t"
+        "b.gt 1b\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "x0", "x1", "memory"
+    );
+}
+
+
+static void mem_write_test_armasm_nt(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t);
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "mov x0, %[mem]\n\t"
+        "mov x1, %[len]\n\t"
+    "1: \n\t"
+        "stnp %[v], %[v], [x0]\n\t"
+        "add x0, x0, #16\n\t"
+        "subs x1, x1, #2\n\t"
+        "b.gt 1b\n\t"
+        "dsb ishst\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "x0", "x1", "memory"
+    );
+}
+
+
+static void mem_write_test_armasm_nt_x8(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    size_t len = size / sizeof(uint64_t);
+    uint64_t *mem = ptr;
+    __asm__ __volatile__(
+        "mov x0, %[mem]\n\t"
+        "mov x1, %[len]\n\t"
+    "1: \n\t"
+        "stnp %[v], %[v], [x0]\n\t"
+        "stnp %[v], %[v], [x0, #16]\n\t"
+        "stnp %[v], %[v], [x0, #32]\n\t"
+        "stnp %[v], %[v], [x0, #48]\n\t"
+        "stnp %[v], %[v], [x0, #64]\n\t"
+        "stnp %[v], %[v], [x0, #80]\n\t"
+        "stnp %[v], %[v], [x0, #96]\n\t"
+        "stnp %[v], %[v], [x0, #112]\n\t"
+        "add x0, x0, #128\n\t"
+        "subs x1, x1, #16\n\t"
+        "b.gt 1b\n\t"
+        "dsb ishst\n\t"
+        :
+        : [mem] "r" (mem),
+          [len] "r" (len),
+          [v] "r" (v)
+        : "x0", "x1", "memory"
+    );
+}
+#endif  // aarch64
+
+
+#ifdef __ARM_NEON
+static void mem_write_test_armneon(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    uint64x2_t vec = vdupq_n_u64(v);
+    uint64x2_t *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(uint64x2_t); i++) {
+        vst1q_u64((uint64_t*) (mem + i), vec);
+    }
+}
+
+
+// A64 stores have no aligned form, so this differs from armneon only in
+// going through bytes, with no 16 byte alignment implied by the pointer type.
+static void mem_write_test_armneon_u(void *ptr, size_t size, size_t iter) {
+    const uint8x16_t vec = vdupq_n_u8(iter % 0xff);
+    uint8_t *mem = ptr;
+    for (size_t i = 0; i + sizeof(uint8x16_t) <= size; i += sizeof(uint8x16_t)) {
+        vst1q_u8(mem + i, vec);
+    }
+}
+#endif  // arm_neon
+
+
+static void mem_write_test_c(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    uint64_t *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+        mem[i] = v;
+    }
+}
+
+
+static void mem_write_test_c_x8(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    uint64_t *mem = ptr;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i += 8) {
+        mem[i] = v;
+        mem[i + 1] = v;
+        mem[i + 2] = v;
+        mem[i + 3] = v;
+        mem[i + 4] = v;
+        mem[i + 5] = v;
+        mem[i + 6] = v;
+        mem[i + 7] = v;
+    }
+}
+
+
+static void mem_write_test_c_x32(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    uint64_t *m = ptr;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i += 32) {
+        m[i]    = v; m[i+1]  = v; m[i+2]  = v; m[i+3]  = v; m[i+4]  = v; m[i+5]  = v; m[i+6]  = v; m[i+7]  = v;
+        m[i+8]  = v; m[i+9]  = v; m[i+10] = v; m[i+11] = v; m[i+12] = v; m[i+13] = v; m[i+14] = v; m[i+15] = v;
+        m[i+16] = v; m[i+17] = v; m[i+18] = v; m[i+19] = v; m[i+20] = v; m[i+21] = v; m[i+22] = v; m[i+23] = v;
+        m[i+24] = v; m[i+25] = v; m[i+26] = v; m[i+27] = v; m[i+28] = v; m[i+29] = v; m[i+30] = v; m[i+31] = v;
+    }
+}
+
+
+static void mem_write_test_c_x128(void *ptr, size_t size, size_t iter) {
+    const uint64_t b = iter % 0xff;
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        v = (v << 8) | b;
+    }
+    uint64_t *m = ptr;
+    for (size_t i = 0; i < size / sizeof(uint64_t);) {
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+    }
+}
+
+
+static void mem_write_test_memset(void *ptr, size_t size, size_t iter) {
+    const char b = iter % 0xff;
+    memset(ptr, b, size);
+}
+
+
+// The first page doubles as the copy source, so nothing is allocated in the
+// timed loop and the source stays hot in L1.
+static void mem_write_test_memcpy(void *ptr, size_t size, size_t iter) {
+    const char b = iter % 0xff;
+    char *mem = ptr;
+    memset(mem, b, MIN(g_page_size, size));
+    for (size_t i = g_page_size; i < size; i += g_page_size) {
+        memcpy(mem + i, mem, MIN(g_page_size, size - i));
+    }
+}
+
+
+// Write back kernels: each line is stored like the _x8 kernels, then written
+// back with FLUSH, and FENCE waits for the page's write backs to complete, the
+// granularity a persistence or cross-process publish would commit at.
+#ifdef __x86_64__
+# define X86_FLUSH_TEST(name, flush, fence) \
+static void mem_write_test_##name(void *ptr, size_t size, size_t iter) { \
+    const uint64_t b = iter % 0xff; \
+    uint64_t v = 0; \
+    for (size_t i = 0; i < sizeof(uint64_t); i++) { \
+        v = (v << 8) | b; \
+    } \
+    char *end = (char*) ptr + size; \
+    for (char *page = ptr; page < end; page += g_page_size) { \
+        size_t lines = MIN(g_page_size, (size_t) (end - page)) / MS_CACHE_LINE; \
+        if (lines == 0) { \
+            break; \
+        } \
+        __asm__ __volatile__( \
+            "movq %[mem], %%rdx\n\t" \
+            "movq %[len], %%rcx\n\t" \
+        "1:\n\t" \
+            "movq %[v], (%%rdx)\n\t" \
+            "movq %[v], 8(%%rdx)\n\t" \
+            "movq %[v], 16(%%rdx)\n\t" \
+            "movq %[v], 24(%%rdx)\n\t" \
+            "movq %[v], 32(%%rdx)\n\t" \
+            "movq %[v], 40(%%rdx)\n\t" \
+            "movq %[v], 48(%%rdx)\n\t" \
+            "movq %[v], 56(%%rdx)\n\t" \
+            flush " (%%rdx)\n\t" \
+            "addq $64, %%rdx\n\t" \
+            "dec %%rcx\n\t" \
+            "jnz 1b\n\t" \
+            fence "\n\t" \
+            : \
+            : [mem] "r" (page), \
+              [len] "r" (lines), \
+              [v] "r" (v) \
+            : "rcx", "rdx", "memory" \
+        ); \
+    } \
+}
+
+// CLFLUSH is only ordered by MFENCE; CLFLUSHOPT and CLWB by SFENCE.  CLDEMOTE
+// is a hint with nothing to wait for.
+X86_FLUSH_TEST(clflush, "clflush", "mfence")
+X86_FLUSH_TEST(clflushopt, "clflushopt", "sfence")
+X86_FLUSH_TEST(clwb, "clwb", "sfence")
+X86_FLUSH_TEST(cldemote, "cldemote", "")
+
+
+static bool x86_has_flush(ms_write_test test) {
+    unsigned int eax, ebx, ecx, edx;
+    if (test == mem_write_test_clflush) {
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & (1 << 19));
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    if (test == mem_write_test_clflushopt) {
+        return ebx & (1 << 23);
+    } else if (test == mem_write_test_clwb) {
+        return ebx & (1 << 24);
+    } else if (test == mem_write_test_cldemote) {
+        return ecx & (1 << 25);
+    }
+    return true;
+}
+#endif
+
+
+#ifdef __aarch64__
+// DC ops act on the line holding the address, so with 128 byte lines every
+// other one is redundant but harmless.  DC CVAP is written as SYS so older
+// assemblers without armv8.2-a accept it.
+# define ARM_FLUSH_TEST(name, flush) \
+static void mem_write_test_##name(void *ptr, size_t size, size_t iter) { \
+    const uint64_t b = iter % 0xff; \
+    uint64_t v = 0; \
+    for (size_t i = 0; i < sizeof(uint64_t); i++) { \
+        v = (v << 8) | b; \
+    } \
+    char *end = (char*) ptr + size; \
+    for (char *page = ptr; page < end; page += g_page_size) { \
+        size_t lines = MIN(g_page_size, (size_t) (end - page)) / MS_CACHE_LINE; \
+        if (lines == 0) { \
+            break; \
+        } \
+        __asm__ __volatile__( \
+            "mov x0, %[mem]\n\t" \
+            "mov x1, %[len]\n\t" \
+        "1: \n\t" \
+            "stp %[v], %[v], [x0]\n\t" \
+            "stp %[v], %[v], [x0, #16]\n\t" \
+            "stp %[v], %[v], [x0, #32]\n\t" \
+            "stp %[v], %[v], [x0, #48]\n\t" \
+            flush ", x0\n\t" \
+            "add x0, x0, #64\n\t" \
+            "subs x1, x1, #1\n\t" \
+            "b.gt 1b\n\t" \
+            "dsb ish\n\t" \
+            : \
+            : [mem] "r" (page), \
+              [len] "r" (lines), \
+              [v] "r" (v) \
+            : "x0", "x1", "memory", "cc" \
+        ); \
+    } \
+}
+
+ARM_FLUSH_TEST(dc_cvac, "dc cvac")
+ARM_FLUSH_TEST(dc_civac, "dc civac")
+ARM_FLUSH_TEST(dc_cvap, "sys #3, c7, c12, #1")
+
+
+static bool arm_has_flush(ms_write_test test) {
+    if (test == mem_write_test_dc_cvap) {
+# ifdef __linux__
+        return getauxval(AT_HWCAP) & HWCAP_DCPOP;
+# else
+        return false;
+# endif
+    }
+    return true;
+}
+#endif
+
+
+// Strided kernels write blocks bytes every stride bytes in one call, so an
+// interleaved shard pays one call per pass rather than one per block.  flatten
+// inlines the block kernel, leaving only the address pattern to differ.
+#define STRIDED_TEST(name) \
+__attribute__((flatten)) \
+static void mem_write_strided_##name(void *ptr, size_t block, size_t stride, size_t blocks, size_t iter) { \
+    char *mem = ptr; \
+    for (size_t i = 0; i < blocks; i++, mem += stride) { \
+        mem_write_test_##name(mem, block, iter); \
+    } \
+}
+
+STRIDED_TEST(c)
+STRIDED_TEST(c_x8)
+STRIDED_TEST(c_x32)
+STRIDED_TEST(c_x128)
+STRIDED_TEST(memset)
+STRIDED_TEST(memcpy)
+#ifdef __x86_64__
+STRIDED_TEST(x86asm)
+STRIDED_TEST(x86asm_nt)
+STRIDED_TEST(x86asm_x8)
+STRIDED_TEST(x86asm_nt_x8)
+STRIDED_TEST(x86asm_x32)
+STRIDED_TEST(x86asm_nt_x32)
+STRIDED_TEST(clflush)
+STRIDED_TEST(clflushopt)
+STRIDED_TEST(clwb)
+STRIDED_TEST(cldemote)
+#endif
+#ifdef __AVX2__
+STRIDED_TEST(avx2)
+STRIDED_TEST(avx2_nt)
+STRIDED_TEST(avx2_u)
+# ifdef __AVX512F__
+STRIDED_TEST(avx512)
+STRIDED_TEST(avx512_nt)
+STRIDED_TEST(avx512_u)
+# endif
+#endif
+#ifdef __aarch64__
+STRIDED_TEST(armasm)
+STRIDED_TEST(armasm_nt)
+STRIDED_TEST(armasm_x8)
+STRIDED_TEST(armasm_nt_x8)
+STRIDED_TEST(dc_cvac)
+STRIDED_TEST(dc_civac)
+STRIDED_TEST(dc_cvap)
+# ifdef __ARM_NEON
+STRIDED_TEST(armneon)
+STRIDED_TEST(armneon_u)
+# endif
+#endif
+
+
+static const ms_strategy_t strategies[] = {
+    {"c", "A C loop subject to compiler optimizations", mem_write_test_c, mem_write_strided_c, 8, 8},
+    {"c_x8", "A C loop with 8 x 64bit writes", mem_write_test_c_x8, mem_write_strided_c_x8, 8, 64},
+    {"c_x32", "A C loop with 32 x 64bit writes", mem_write_test_c_x32, mem_write_strided_c_x32, 8, 256},
+    {"c_x128", "A C loop with 128 x 64bit writes", mem_write_test_c_x128, mem_write_strided_c_x128, 8, 1024},
+    {"memset", "Byte by byte memset() in a loop", mem_write_test_memset, mem_write_strided_memset, 0, 1},
+    {"memcpy", "memcpy() of the first page over the rest", mem_write_test_memcpy, mem_write_strided_memcpy, 0, 0},
+#ifdef __x86_64__
+    {"x86asm", "64bit x86 ASM", mem_write_test_x86asm, mem_write_strided_x86asm, 0, 8},
+    {"x86asm_nt", "64bit x86 ASM (non-temporal)", mem_write_test_x86asm_nt, mem_write_strided_x86asm_nt, 0, 8},
+    {"x86asm_x8", "8 x 64bit x86 ASM", mem_write_test_x86asm_x8, mem_write_strided_x86asm_x8, 0, 64},
+    {"x86asm_nt_x8", "8 x 64bit x86 ASM (non-temporal)", mem_write_test_x86asm_nt_x8, mem_write_strided_x86asm_nt_x8, 0, 64},
+    {"x86asm_x32", "32 x 64bit x86 ASM", mem_write_test_x86asm_x32, mem_write_strided_x86asm_x32, 0, 256},
+    {"x86asm_nt_x32", "32 x 64bit x86 ASM (non-temporal)", mem_write_test_x86asm_nt_x32, mem_write_strided_x86asm_nt_x32, 0, 256},
+#endif
+#ifdef __AVX2__
+    {"avx2", "256bit AVX2 intrinsics", mem_write_test_avx2, mem_write_strided_avx2, 32, 32},
+    {"avx2_nt", "256bit AVX2 intrinsics (non-temporal)", mem_write_test_avx2_nt, mem_write_strided_avx2_nt, 32, 32},
+    {"avx2_u", "256bit AVX2 intrinsics (unaligned stores)", mem_write_test_avx2_u, mem_write_strided_avx2_u, 0, 32},
+# ifdef __AVX512F__
+    {"avx512", "512bit AVX512 intrinsics", mem_write_test_avx512, mem_write_strided_avx512, 64, 64},
+    {"avx512_nt", "512bit AVX512 intrinsics (non-temporal)", mem_write_test_avx512_nt, mem_write_strided_avx512_nt, 64, 64},
+    {"avx512_u", "512bit AVX512 intrinsics (unaligned stores)", mem_write_test_avx512_u, mem_write_strided_avx512_u, 0, 64},
+# endif
+#endif
+#ifdef __aarch64__
+    {"armasm", "128bit ARM ASM (STP)", mem_write_test_armasm, mem_write_strided_armasm, 0, 16},
+    {"armasm_nt", "128bit ARM ASM (non-temporal, STNP)", mem_write_test_armasm_nt, mem_write_strided_armasm_nt, 0, 16},
+    {"armasm_x8", "8 x 128bit ARM ASM (STP)", mem_write_test_armasm_x8, mem_write_strided_armasm_x8, 0, 128},
+    {"armasm_nt_x8", "8 x 128bit ARM ASM (non-temporal, SSTP)", mem_write_test_armasm_nt_x8, mem_write_strided_armasm_nt_x8, 0, 128},
+# ifdef __ARM_NEON
+    {"armneon", "128bit ARM NEON SIMD intrinsics", mem_write_test_armneon, mem_write_strided_armneon, 16, 16},
+    {"armneon_u", "128bit ARM NEON SIMD intrinsics (unaligned stores)", mem_write_test_armneon_u, mem_write_strided_armneon_u, 0, 16},
+# endif
+#endif
+#ifdef __x86_64__
+    {"clflush", "8 x 64bit x86 ASM, CLFLUSH per line, MFENCE per page", mem_write_test_clflush, mem_write_strided_clflush, 0, 64},
+    {"clflushopt", "8 x 64bit x86 ASM, CLFLUSHOPT per line, SFENCE per page", mem_write_test_clflushopt, mem_write_strided_clflushopt, 0, 64},
+    {"clwb", "8 x 64bit x86 ASM, CLWB per line, SFENCE per page", mem_write_test_clwb, mem_write_strided_clwb, 0, 64},
+    {"cldemote", "8 x 64bit x86 ASM, CLDEMOTE per line", mem_write_test_cldemote, mem_write_strided_cldemote, 0, 64},
+#endif
+#ifdef __aarch64__
+    {"dc_cvac", "4 x 128bit ARM ASM (STP), DC CVAC per line, DSB per page", mem_write_test_dc_cvac, mem_write_strided_dc_cvac, 0, 64},
+    {"dc_civac", "4 x 128bit ARM ASM (STP), DC CIVAC per line, DSB per page", mem_write_test_dc_civac, mem_write_strided_dc_civac, 0, 64},
+    {"dc_cvap", "4 x 128bit ARM ASM (STP), DC CVAP per line, DSB per page", mem_write_test_dc_cvap, mem_write_strided_dc_cvap, 0, 64},
+#endif
+    {NULL, NULL, NULL, NULL, 0, 0}
+};
+
+// strategies[] less the write back kernels this CPU lacks.
+static ms_strategy_t available[sizeof(strategies) / sizeof(strategies[0])];
+static pthread_once_t available_once = PTHREAD_ONCE_INIT;
+
+
+static void init_available(void) {
+    size_t n = 0;
+    for (const ms_strategy_t *s = strategies; s->name != NULL; s++) {
+#ifdef __x86_64__
+        if (!x86_has_flush(s->test)) {
+            continue;
+        }
+#endif
+#ifdef __aarch64__
+        if (!arm_has_flush(s->test)) {
+            continue;
+        }
+#endif
+        available[n++] = *s;
+    }
+}
+
+
+const ms_strategy_t *ms_strategies(void) {
+    pthread_once(&available_once, init_available);
+    return available;
+}
+
+
+// Reject kernel calls of size bytes at ctx->offset that a built in strategy's
+// unrolled or aligned stores would overrun or fault on.  Other tests pass.
+static int check_strategy_fit(ms_ctx_t *ctx, ms_write_test test, size_t size) {
+    for (const ms_strategy_t *s = strategies; s->name != NULL; s++) {
+        if (s->test != test) {
+            continue;
+        }
+        const size_t unit = s->unit > 0 ? s->unit : g_page_size;
+        if (s->align > 0 && ctx->offset % s->align) {
+            ms_set_error(ctx, "Strategy %s needs %zu byte aligned stores, got offset %zu", s->name,
+                s->align, ctx->offset);
+            return -1;
+        }
+        if (size < unit || size % unit) {
+            ms_set_error(ctx, "Strategy %s writes %zu byte units, got %zu byte blocks", s->name, unit, size);
+            return -1;
+        }
+        break;
+    }
+    return 0;
+}
+
+
+// The strided form of a built in strategy's test, NULL for other tests.
+static ms_strided_test find_strided(ms_write_test test) {
+    for (const ms_strategy_t *s = strategies; s->name != NULL; s++) {
+        if (s->test == test) {
+            return s->strided;
+        }
+    }
+    return NULL;
+}
+
+
+const ms_strategy_t *ms_strategy_find(const char *name) {
+    for (const ms_strategy_t *s = ms_strategies(); s->name != NULL; s++) {
+        if (strcmp(s->name, name) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+
+#ifdef __linux__
+static cpus_topology_t * get_cpus_topology() {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    sched_getaffinity(0, sizeof(cpuset), &cpuset); // has ambiguous return value
+    int count = CPU_COUNT(&cpuset);
+    if (count < 1 || count > 0xffff) {
+        errno = ENOENT;
+        return NULL;
+    }
+    cpus_topology_t *topo = malloc(sizeof(cpus_topology_t));
+    if (topo == NULL) {
+        return NULL;
+    }
+    topo->cpus = calloc(count, sizeof(topo->cpus[0]));
+    if (topo->cpus == NULL) {
+        free(topo);
+        return NULL;
+    }
+    topo->count = count;
+    for (int cpu = 0, i = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &cpuset)) {
+            topo->cpus[i++] = cpu;
+        }
+    }
+    return topo;
+}
+
+
+static void free_cpus_topology(cpus_topology_t *topo) {
+    if (topo != NULL) {
+        free(topo->cpus);
+        free(topo);
+    }
+}
+
+
+static void log_cpus_topology(ms_ctx_t *ctx, cpus_topology_t *cpus_topo) {
+    int last_cpu = cpus_topo->cpus[0];
+    ms_log(ctx, "Available CPU cores: %d", last_cpu);
+    bool spanning = false;
+    for (int i = 1; i < cpus_topo->count; i++) {
+        int cpu = cpus_topo->cpus[i];
+        if (last_cpu == cpu - 1) {
+            last_cpu = cpu;
+            spanning = true;
+            continue;
+        }
+        if (spanning) {
+            ms_log(ctx, " -> %d", last_cpu);
+        }
+        ms_log(ctx, ", %d", cpu);
+        spanning = false;
+        last_cpu = cpu;
+    }
+    if (spanning) {
+        ms_log(ctx, " -> %d", cpus_topo->cpus[cpus_topo->count - 1]);
+    }
+    ms_log(ctx, "\n");
+}
+#endif
+
+
+// Report ready and park until the coordinator releases every worker at once.
+static int worker_wait_start(thread_options_t *options) {
+#ifdef __linux__
+    char name[128];
+    snprintf(name, sizeof(name), "memspeed-%03d", options->id);
+    prctl(PR_SET_NAME, name);  // Cosmetic only
+#endif
+    WORKER_ZERO_OR_FAIL(options, pthread_mutex_lock(options->ready_mut));
+    (*options->ready)++;
+    WORKER_ZERO_OR_FAIL(options, pthread_cond_signal(options->ready_cond));
+    WORKER_ZERO_OR_FAIL(options, pthread_mutex_unlock(options->ready_mut));
+
+    WORKER_ZERO_OR_FAIL(options, pthread_mutex_lock(options->start_mut));
+    while (!*options->started) {
+        WORKER_ZERO_OR_FAIL(options, pthread_cond_wait(options->start_cond, options->start_mut));
+    }
+    WORKER_ZERO_OR_FAIL(options, pthread_mutex_unlock(options->start_mut));
+    return 0;
+fail:
+    return -1;
+}
+
+
+static int worker_report(thread_options_t *options, size_t bytes) {
+    ms_ctx_t *ctx = options->ctx;
+    WORKER_ZERO_OR_FAIL(options, pthread_mutex_lock(options->prog_mut));
+    ctx->transferred += bytes;
+    WORKER_ZERO_OR_FAIL(options, pthread_cond_signal(options->prog_cond));
+    WORKER_ZERO_OR_FAIL(options, pthread_mutex_unlock(options->prog_mut));
+    return 0;
+fail:
+    return -1;
+}
+
+
+static void worker_finish(thread_options_t *options) {
+    ms_ctx_t *ctx = options->ctx;
+    if (options->err != 0) {
+        atomic_store(&ctx->stop, true);
+    }
+    // Always report in, otherwise the coordinator waits forever.
+    pthread_mutex_lock(options->prog_mut);
+    (*options->done)++;
+    pthread_cond_signal(options->prog_cond);
+    pthread_mutex_unlock(options->prog_mut);
+}
+
+
+static void* threaded_test_runner(void *_options) {
+    thread_options_t *options = _options;
+    ms_ctx_t *ctx = options->ctx;
+    if (worker_wait_start(options) != 0) {
+        goto fail;
+    }
+    const size_t batch = ms_batch_passes(ctx, options->size);
+    const size_t blocks = options->size / options->block;
+    const double start = ms_time();
+    size_t iter = 1;
+    while (iter <= options->iterations && !atomic_load(&ctx->stop)) {
+        const size_t first = iter;
+        const size_t end = MIN(first + batch, options->iterations + 1);
+        for (; iter < end; iter++) {
+            if (options->strided != NULL) {
+                options->strided(options->mem, options->block, options->stride, blocks, iter);
+                continue;
+            }
+            char *block = options->mem;
+            for (size_t b = 0; b < blocks; b++, block += options->stride) {
+                options->test(block, options->block, iter);
+            }
+        }
+        options->chunks += end - first;
+        options->time = ms_time() - start;
+        if (worker_report(options, options->size * (end - first)) != 0) {
+            goto fail;
+        }
+    }
+fail:
+    worker_finish(options);
+    return NULL;
+}
+
+
+// Claim chunks from the shared counter until every chunk of the transfer is
+// taken.  Claim n covers chunk n % buffer_chunks of pass n / buffer_chunks.
+static void* chunked_test_runner(void *_options) {
+    thread_options_t *options = _options;
+    ms_ctx_t *ctx = options->ctx;
+    if (worker_wait_start(options) != 0) {
+        goto fail;
+    }
+    const size_t batch = ms_batch_passes(ctx, options->chunk_size);
+    const size_t total = options->iterations * options->buffer_chunks;
+    const double start = ms_time();
+    bool more = true;
+    while (more && !atomic_load(&ctx->stop)) {
+        size_t claimed = 0;
+        while (claimed < batch) {
+            size_t n = atomic_fetch_add_explicit(options->next_chunk, 1, memory_order_relaxed);
+            if (n >= total) {
+                more = false;
+                break;
+            }
+            char *chunk = (char*) options->mem + (n % options->buffer_chunks) * options->chunk_size;
+            options->test(chunk + ctx->offset, options->size, n / options->buffer_chunks + 1);
+            claimed++;
+        }
+        options->chunks += claimed;
+        options->time = ms_time() - start;
+        if (claimed > 0 && worker_report(options, options->size * claimed) != 0) {
+            goto fail;
+        }
+    }
+fail:
+    worker_finish(options);
+    return NULL;
+}
+
+
+// Bytes a shifted shard gives up at its end: a whole page, so every kernel
+// still sees a size it can unroll over.
+static size_t shifted_trim(const ms_ctx_t *ctx) {
+    return ctx->offset > 0 ? g_page_size : 0;
+}
+
+
+static int check_bench_args(ms_ctx_t *ctx, size_t buffer_size, size_t transfer_size) {
+    if (buffer_size < 1 || transfer_size < buffer_size || ctx->threads < 1 ||
+        buffer_size % ctx->threads || ctx->offset >= MS_CACHE_LINE) {
+        ms_set_error(ctx, "Invalid bench args");
+        return -1;
+    }
+    ctx->transferred = 0;
+    ctx->end_time = 0;
+    ctx->start_ticks = 0;
+    ctx->end_ticks = 0;
+    atomic_store(&ctx->stop, false);
+    return 0;
+}
+
+
+int ms_bench_threaded(ms_ctx_t *ctx, void *mem, size_t buffer_size, size_t transfer_size,
+                      ms_write_test test) {
+    if (check_bench_args(ctx, buffer_size, transfer_size) != 0) {
+        return -1;
+    }
+    const size_t thread_count = ctx->threads;
+    int ret = -1;
+    size_t created = 0;
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    thread_options_t *options = calloc(thread_count, sizeof(thread_options_t));
+    int *thread_cpus = realloc(ctx->thread_cpus, thread_count * sizeof(int));
+    if (thread_cpus != NULL) {
+        ctx->thread_cpus = thread_cpus;
+    }
+    size_t *thread_chunks = realloc(ctx->thread_chunks, thread_count * sizeof(size_t));
+    if (thread_chunks != NULL) {
+        ctx->thread_chunks = thread_chunks;
+    }
+    double *thread_times = realloc(ctx->thread_times, thread_count * sizeof(double));
+    if (thread_times != NULL) {
+        ctx->thread_times = thread_times;
+    }
+    if (threads == NULL || options == NULL || thread_cpus == NULL || thread_chunks == NULL ||
+        thread_times == NULL) {
+        ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        free(threads);
+        free(options);
+        return -1;
+    }
+    const bool chunked = ctx->sched == MS_SCHED_CHUNKED;
+    const size_t chunk_size = ms_chunk_size(ctx, buffer_size);
+    if (chunked && (chunk_size < 1 || chunk_size % g_page_size || buffer_size % chunk_size)) {
+        ms_set_error(ctx, "Chunk size %zu must be whole pages dividing buffer size %zu",
+            chunk_size, buffer_size);
+        free(threads);
+        free(options);
+        return -1;
+    }
+    const size_t shard_size = buffer_size / thread_count;
+    const size_t trim = shifted_trim(ctx);
+    if ((chunked ? chunk_size : shard_size) <= trim) {
+        ms_set_error(ctx, "Offset shards and chunks must be larger than a page");
+        free(threads);
+        free(options);
+        return -1;
+    }
+    const bool interleaved = ctx->layout != MS_LAYOUT_CONTIGUOUS;
+    const size_t block = interleaved ? ms_layout_block(ctx, shard_size) : shard_size - trim;
+    if (interleaved && (chunked || trim > 0 || block < MS_CACHE_LINE || block % MS_CACHE_LINE ||
+                        shard_size % block)) {
+        ms_set_error(ctx, "Interleaved %s layout needs static scheduling, no offset and %zu byte "
+            "blocks of whole lines dividing the %zu byte shards", layout_names[ctx->layout], block, shard_size);
+        free(threads);
+        free(options);
+        return -1;
+    }
+    if (check_strategy_fit(ctx, test, chunked ? chunk_size - trim : block) != 0) {
+        free(threads);
+        free(options);
+        return -1;
+    }
+    atomic_size_t next_chunk;
+    atomic_init(&next_chunk, 0);
+
+    pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+    pthread_mutex_t ready_mut = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+    pthread_mutex_t start_mut = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t prog_cond = PTHREAD_COND_INITIALIZER;
+    pthread_mutex_t prog_mut = PTHREAD_MUTEX_INITIALIZER;
+    size_t ready = 0;
+    size_t done = 0;
+    bool started = false;
+
+#ifdef __linux__
+    cpus_topology_t *cpus_topo = get_cpus_topology();
+    if (cpus_topo == NULL) {
+        ms_set_error(ctx, "Failed to get CPU topology: %s", strerror(errno));
+        goto fail;
+    }
+    log_cpus_topology(ctx, cpus_topo);
+#endif
+
+    for (size_t i = 0; i < thread_count; i++) {
+        thread_options_t *o = &options[i];
+        o->id = i;
+        o->ctx = ctx;
+        o->test = test;
+        o->strided = interleaved ? find_strided(test) : NULL;
+        o->mem = chunked ? mem : (char*) mem + (interleaved ? block : shard_size) * i + ctx->offset;
+        o->size = (chunked ? chunk_size : shard_size) - trim;
+        o->block = block;
+        o->stride = block * thread_count;
+        o->chunk_size = chunk_size;
+        o->buffer_chunks = buffer_size / chunk_size;
+        o->next_chunk = &next_chunk;
+        o->ready = &ready;
+        o->done = &done;
+        o->started = &started;
+        o->ready_cond = &ready_cond;
+        o->ready_mut = &ready_mut;
+        o->start_cond = &start_cond;
+        o->start_mut = &start_mut;
+        o->prog_cond = &prog_cond;
+        o->prog_mut = &prog_mut;
+        o->iterations = transfer_size / buffer_size;
+        ctx->thread_cpus[i] = -1;
+        ZERO_OR_FAIL(ctx, pthread_create(&threads[i], NULL,
+            chunked ? chunked_test_runner : threaded_test_runner, o));
+        created++;
+#ifdef __linux__
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        int cpu = cpus_topo->cpus[o->id % cpus_topo->count];
+        ms_log(ctx, "Thread %d mapped to CPU core: %d\n", o->id, cpu);
+        CPU_SET(cpu, &cpuset);
+        ZERO_OR_FAIL(ctx, pthread_setaffinity_np(threads[i], sizeof(cpuset), &cpuset));
+        ctx->thread_cpus[i] = cpu;
+#endif
+    }
+
+    ZERO_OR_FAIL(ctx, pthread_mutex_lock(&ready_mut));
+    while (ready < thread_count) {
+        ZERO_OR_FAIL(ctx, pthread_cond_wait(&ready_cond, &ready_mut));
+    }
+    ZERO_OR_FAIL(ctx, pthread_mutex_unlock(&ready_mut));
+
+    ms_energy_start(ctx->energy);
+    ZERO_OR_FAIL(ctx, pthread_mutex_lock(&start_mut));
+    started = true;
+    ZERO_OR_FAIL(ctx, pthread_cond_broadcast(&start_cond));
+    ZERO_OR_FAIL(ctx, pthread_mutex_unlock(&start_mut));
+    ctx->start_time = ms_time();
+    ctx->start_ticks = ms_ticks();
+
+    ZERO_OR_FAIL(ctx, pthread_mutex_lock(&prog_mut));
+    while (done < thread_count) {
+        ZERO_OR_FAIL(ctx, pthread_cond_wait(&prog_cond, &prog_mut));
+        if (ctx->progress != NULL) {
+            ctx->progress(ctx, ctx->progress_arg);
+        }
+    }
+    ctx->end_ticks = ms_ticks();
+    ctx->end_time = ms_time();
+    ms_energy_stop(ctx->energy);
+    ZERO_OR_FAIL(ctx, pthread_mutex_unlock(&prog_mut));
+    ret = 0;
+    for (size_t i = 0; i < thread_count; i++) {
+        if (options[i].err != 0) {
+            ms_set_error(ctx, "Thread %zu failed: %s", i, strerror(options[i].err));
+            ret = -1;
+        }
+    }
+
+fail:
+    if (ret != 0 && created > 0) {
+        // Release anything still parked at the start line.
+        atomic_store(&ctx->stop, true);
+        pthread_mutex_lock(&start_mut);
+        started = true;
+        pthread_cond_broadcast(&start_cond);
+        pthread_mutex_unlock(&start_mut);
+    }
+    for (size_t i = 0; i < created; i++) {
+        pthread_join(threads[i], NULL);
+        ctx->thread_chunks[i] = options[i].chunks;
+        ctx->thread_times[i] = options[i].time;
+    }
+#ifdef __linux__
+    free_cpus_topology(cpus_topo);
+#endif
+    free(threads);
+    free(options);
+    return ret;
+}
+
+
+static void* pinned_worker_runner(void *_worker) {
+    pinned_worker_t *worker = _worker;
+    pthread_mutex_lock(worker->start_mut);
+    while (!*worker->started) {
+        pthread_cond_wait(worker->start_cond, worker->start_mut);
+    }
+    pthread_mutex_unlock(worker->start_mut);
+    worker->fn(worker->arg);
+    return NULL;
+}
+
+
+int ms_run_pinned(ms_ctx_t *ctx, void (*fn)(void *arg), void *args, size_t arg_size) {
+    return ms_run_on_cpus(ctx, fn, args, arg_size, ctx->threads, NULL);
+}
+
+
+int ms_run_on_cpus(ms_ctx_t *ctx, void (*fn)(void *arg), void *args, size_t arg_size,
+                   size_t thread_count, const int *cpus) {
+    int ret = -1;
+    size_t created = 0;
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    pinned_worker_t *workers = calloc(thread_count, sizeof(pinned_worker_t));
+    int *thread_cpus = realloc(ctx->thread_cpus, thread_count * sizeof(int));
+    if (thread_cpus != NULL) {
+        ctx->thread_cpus = thread_cpus;
+    }
+    if (threads == NULL || workers == NULL || thread_cpus == NULL) {
+        ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        free(threads);
+        free(workers);
+        return -1;
+    }
+    pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+    pthread_mutex_t start_mut = PTHREAD_MUTEX_INITIALIZER;
+    bool started = false;
+
+#ifdef __linux__
+    cpus_topology_t *cpus_topo = get_cpus_topology();
+    if (cpus_topo == NULL) {
+        ms_set_error(ctx, "Failed to get CPU topology: %s", strerror(errno));
+        goto fail;
+    }
+#endif
+    for (size_t i = 0; i < thread_count; i++) {
+        workers[i].fn = fn;
+        workers[i].arg = (char*) args + i * arg_size;
+        workers[i].started = &started;
+        workers[i].start_cond = &start_cond;
+        workers[i].start_mut = &start_mut;
+        ctx->thread_cpus[i] = -1;
+        ZERO_OR_FAIL(ctx, pthread_create(&threads[i], NULL, pinned_worker_runner, &workers[i]));
+        created++;
+#ifdef __linux__
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        int cpu = cpus != NULL ? cpus[i] : cpus_topo->cpus[i % cpus_topo->count];
+        CPU_SET(cpu, &cpuset);
+        ZERO_OR_FAIL(ctx, pthread_setaffinity_np(threads[i], sizeof(cpuset), &cpuset));
+        ctx->thread_cpus[i] = cpu;
+#endif
+    }
+    ret = 0;
+
+fail:
+    // Release workers even on failure so they can be joined; stop tells any
+    // waiting on a partner that never started to give up.
+    if (ret != 0) {
+        atomic_store(&ctx->stop, true);
+    }
+    pthread_mutex_lock(&start_mut);
+    started = true;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_mut);
+    for (size_t i = 0; i < created; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#ifdef __linux__
+    free_cpus_topology(cpus_topo);
+#endif
+    free(threads);
+    free(workers);
+    return ret;
+}
+
+
+int ms_bench(ms_ctx_t *ctx, void *mem, size_t buffer_size, size_t transfer_size, ms_write_test test) {
+    if (check_bench_args(ctx, buffer_size, transfer_size) != 0) {
+        return -1;
+    }
+    const size_t iterations = transfer_size / buffer_size;
+    if (buffer_size <= shifted_trim(ctx)) {
+        ms_set_error(ctx, "Offset buffers must be larger than a page");
+        return -1;
+    }
+    const size_t span = buffer_size - shifted_trim(ctx);
+    if (check_strategy_fit(ctx, test, span) != 0) {
+        return -1;
+    }
+    const size_t batch = ms_batch_passes(ctx, buffer_size);
+    ms_energy_start(ctx->energy);
+    ctx->start_time = ms_time();
+    ctx->start_ticks = ms_ticks();
+    size_t iter = 1;
+    while (iter <= iterations && !atomic_load(&ctx->stop)) {
+        const size_t first = iter;
+        const size_t end = MIN(first + batch, iterations + 1);
+        for (; iter < end; iter++) {
+            test((char*) mem + ctx->offset, span, iter);
+        }
+        ctx->transferred += span * (end - first);
+        if (ctx->progress != NULL) {
+            ctx->progress(ctx, ctx->progress_arg);
+        }
+    }
+    ctx->end_ticks = ms_ticks();
+    ctx->end_time = ms_time();
+    ms_energy_stop(ctx->energy);
+    return 0;
+}
@@ -7,45 +7,24 @@
 #include <string.h>
 #include <stdbool.h>
 #include <errno.h>
-#include <time.h>
 #include <assert.h>
 #include <signal.h>
-#include <pthread.h>
+#include <sched.h>
+#include <glob.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/param.h>
-#include <sys/mman.h>
-#ifdef __linux__
-# include <sys/prctl.h>
-#endif
-#if defined(__AVX2__) || defined(__AVX512F__)
-# include <immintrin.h>
-#endif
-#if defined(__aarch64__) && defined(__ARM_NEON)
-# include <arm_neon.h>
-#endif
+#include <sys/socket.h>
+#include <sys/un.h>
 
+#include "memspeed.h"
 
-#define TB (1UL * 1024 * 1024 * 1024 * 1024)
-#define GB (1UL * 1024 * 1024 * 1024)
-#define MB (1UL * 1024 * 1024)
 
+#define TB MS_TB
+#define GB MS_GB
+#define MB MS_MB
 
-typedef void (*mem_write_test)(void *ptr, size_t size, size_t iter);
-
-typedef struct thread_options {
-    int id;
-    mem_write_test test;
-    void *mem;
-    size_t size;
-    size_t iterations;
-    size_t *ready;
-    size_t *done;
-    pthread_cond_t *ready_cond;
-    pthread_mutex_t *ready_mut;
-    pthread_cond_t *start_cond;
-    pthread_mutex_t *start_mut;
-    pthread_cond_t *prog_cond;
-    pthread_mutex_t *prog_mut;
-} thread_options_t;
 
 typedef struct draw_state {
     size_t ticks;
@@ -53,26 +32,121 @@ typedef struct draw_state {
     double last_time;
 } draw_state_t;
 
-typedef struct cpus_topology {
-    int *cpus;
-    int count;
-} cpus_topology_t;
-
-
-static size_t g_page_size = 0;
-static double g_start_time = 0;
-static size_t g_transferred = 0;
-static size_t g_thread_count = 1;
-static bool g_verbose = false;
-
-
-#define ZERO_OR_EXIT(call) \
-    do { \
-        if ((call) != 0) { \
-            fprintf(stderr, "Non-zero Call error: %s\n", strerror(errno)); \
-            exit(1); \
-        } \
-    } while (0)
+typedef struct soak_sample {
+    double time;
+    double bandwidth;
+    double cpu_mhz;
+    double temp_c;
+} soak_sample_t;
+
+typedef struct soak_state {
+    double duration;
+    double interval;
+    double end_time;
+    double next_time;
+    double last_time;
+    size_t last_sz;
+    glob_t temp_paths;
+    soak_sample_t *samples;
+    size_t count;
+    size_t capacity;
+} soak_state_t;
+
+// Bandwidth over fixed windows of the run, for min/median/max/stdev.
+typedef struct stats_state {
+    double last_time;
+    size_t last_sz;
+    double *samples;
+    size_t count;
+    size_t capacity;
+} stats_state_t;
+
+typedef struct bw_stats {
+    double avg;
+    double median;
+    double min;
+    double max;
+    double stdev;
+    size_t samples;
+} bw_stats_t;
+
+typedef struct baseline {
+    char strategy[64];
+    size_t buffer_size;
+    size_t transfer_size;
+    size_t threads;
+    char source[1024];
+    char pages[16];
+    char sched[16];
+    size_t chunk_size;          // As given, 0 for the default
+    char layout[16];
+    size_t block_size;
+    size_t offset;
+    size_t batch;
+    char cpus[1024];
+    bw_stats_t stats;
+} baseline_t;
+
+// One fully expanded line of a suite file grid.
+typedef struct suite_run {
+    char strategy[64];
+    size_t buffer_size;
+    size_t threads;
+    char source[1024];
+    char pages[16];
+    char sched[16];
+    size_t transfer_size;
+    // Results
+    size_t transferred;
+    double time;
+    bool done;
+} suite_run_t;
+
+typedef struct suite {
+    suite_run_t *runs;
+    size_t count;
+    size_t capacity;
+} suite_t;
+
+#define SUITE_KEYS 7
+#define SUITE_MAX_VALUES 64
+
+#define DAEMON_BUCKETS 10
+
+// Cumulative Prometheus histogram; counts[i] holds observations <= bounds[i].
+typedef struct histogram {
+    const double *bounds;
+    size_t counts[DAEMON_BUCKETS];
+    size_t count;
+    double sum;
+} histogram_t;
+
+typedef struct daemon_state {
+    double interval;
+    double budget;              // Max share of one CPU, in percent
+    const char *textfile;
+    const char *socket_path;
+    const char *strategy;
+    int listen_fd;
+    size_t probes;
+    double last_speed;
+    double last_latency;
+    double last_runtime;
+    double last_probe;          // Unix time
+    histogram_t speed;
+    histogram_t latency;
+    char text[8192];
+} daemon_state_t;
+
+typedef struct progress_state {
+    draw_state_t draw;
+    soak_state_t *soak;
+    stats_state_t stats;
+} progress_state_t;
+
+
+static ms_ctx_t *g_ctx = NULL;
+static soak_state_t *g_soak = NULL;
 
 
 // A static buffer allocated on the stack is used for this..
@@ -106,13 +180,60 @@ static char *human_size(size_t bytes) {
 }
 
 
-static double get_time() {
-    struct timespec tspec;
-    if (clock_gettime(CLOCK_MONOTONIC, &tspec) != 0) {
-        fprintf(stderr, "Get time error");
+// Same buffer rules as human_size, for rates and counts in SI units.
+static char *human_count(double count) {
+    static _Thread_local size_t buf_idx = 0;
+    static _Thread_local char bufs[10][64];
+    const size_t i = buf_idx;
+    buf_idx = (buf_idx + 1) % 10;
+    if (count >= 1e9) {
+        snprintf(bufs[i], sizeof(bufs[i]), "%.2f G", count / 1e9);
+    } else if (count >= 1e6) {
+        snprintf(bufs[i], sizeof(bufs[i]), "%.2f M", count / 1e6);
+    } else if (count >= 1e3) {
+        snprintf(bufs[i], sizeof(bufs[i]), "%.2f K", count / 1e3);
+    } else {
+        snprintf(bufs[i], sizeof(bufs[i]), "%.0f ", count);
+    }
+    return bufs[i];
+}
+
+
+// Accepts plain seconds or a single s/m/h suffix, e.g. "90", "30m", "12h".
+static double str_to_duration(char *raw) {
+    errno = 0;
+    char *end;
+    double secs = strtod(raw, &end);
+    if (errno || end == raw || secs <= 0) {
+        fprintf(stderr, "Bad duration: %s\n", raw);
+        exit(1);
+    }
+    if (*end == 'm') {
+        secs *= 60;
+        end++;
+    } else if (*end == 'h') {
+        secs *= 3600;
+        end++;
+    } else if (*end == 's') {
+        end++;
+    }
+    if (*end != '\0') {
+        fprintf(stderr, "Bad duration: %s\n", raw);
+        exit(1);
+    }
+    return secs;
+}
+
+
+static double str_to_pos_double(char *raw) {
+    errno = 0;
+    char *end;
+    double num = strtod(raw, &end);
+    if (errno || end == raw || *end != '\0' || num < 0) {
+        fprintf(stderr, "Bad number: %s\n", raw);
         exit(1);
     }
-    return tspec.tv_sec + tspec.tv_nsec / 1e9;
+    return num;
 }
 
 
@@ -131,785 +252,1572 @@ static uint64_t str_to_pos_u64(char* raw) {
 }
 
 
-static void *alloc(size_t size, int use_mmap) {
-    void *ptr;
-    if (use_mmap != 0) {
-        ptr = mmap(NULL, size, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-        if (ptr == MAP_FAILED) {
-            fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
-            exit(1);
-        }
-    } else {
-        ptr = aligned_alloc(g_page_size, size);
-        if (ptr == NULL) {
-            fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
-            exit(1);
-        }
+// BUFFER_SIZE_MB, or KB with a K suffix for cache sized buffers.
+static size_t str_to_buffer_size(char* raw) {
+    size_t len = strlen(raw);
+    if (len > 1 && (raw[len - 1] == 'K' || raw[len - 1] == 'k')) {
+        raw[len - 1] = '\0';
+        return str_to_pos_u64(raw) * 1024;
     }
-    return ptr;
+    return str_to_pos_u64(raw) * MB;
 }
 
 
-static void dealloc(void *ptr, size_t size, int use_mmap) {
-    if (use_mmap != 0) {
-        munmap((void*) ptr, size);
-    } else {
-        free((void*) ptr);
+// SOURCE is a source name, or file:PATH for MS_SOURCE_FILE.
+static void parse_source(char *raw, ms_buffer_t *buf) {
+    if (strncmp(raw, "file:", 5) == 0 && raw[5] != '\0') {
+        buf->source = MS_SOURCE_FILE;
+        buf->path = raw + 5;
+    } else if (ms_source_parse(raw, &buf->source) != 0 || buf->source == MS_SOURCE_FILE) {
+        fprintf(stderr, "Invalid buffer source: %s\n", raw);
+        exit(1);
     }
 }
 
 
-#ifdef __x86_64__
-static void mem_write_test_x86asm_nt(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t);
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "movq %[mem], %%rdx\n\t"
-        "movq %[len], %%rcx\n\t"
-    "1:\n\t"
-        "movnti %[v], (%%rdx)\n\t"
-        "addq $8, %%rdx\n\t"
-        "dec %%rcx\n\t"
-        "jnz 1b\n\t"
-        "sfence\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "rcx", "rdx", "memory"
-    );
+// Returns MHz or -1 when no frequency source is readable.  The cpufreq
+// sysfs node is preferred; VMs and some kernels only expose /proc/cpuinfo.
+static double read_cpu_mhz(int cpu) {
+#ifdef __linux__
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    FILE *f = fopen(path, "r");
+    if (f != NULL) {
+        unsigned long khz;
+        int n = fscanf(f, "%lu", &khz);
+        fclose(f);
+        if (n == 1) {
+            return khz / 1000.0;
+        }
+    }
+    f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    int cur = -1;
+    double mhz = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "processor : %d", &cur) == 1) {
+            continue;
+        }
+        if (cur == cpu && sscanf(line, "cpu MHz : %lf", &mhz) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return mhz;
+#else
+    (void) cpu;
+    return -1;
+#endif
+}
+
+
+// Hottest reading across all hwmon and thermal zone sensors, or -1000 when
+// none are readable.
+static double read_max_temp_c(glob_t *paths) {
+    double max = -1000;
+    for (size_t i = 0; i < paths->gl_pathc; i++) {
+        FILE *f = fopen(paths->gl_pathv[i], "r");
+        if (f == NULL) {
+            continue;
+        }
+        long milli;
+        if (fscanf(f, "%ld", &milli) == 1 && milli / 1000.0 > max) {
+            max = milli / 1000.0;
+        }
+        fclose(f);
+    }
+    return max;
 }
 
 
-static void mem_write_test_x86asm(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t);
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "movq %[mem], %%rdx\n\t"
-        "movq %[len], %%rcx\n\t"
-    "1:\n\t"
-        "movq %[v], (%%rdx)\n\t"
-        "addq $8, %%rdx\n\t"
-        "dec %%rcx\n\t"
-        "jnz 1b\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "rcx", "rdx", "memory"
-    );
+// Whether cpu is in the sysfs CPU list in path, e.g. "0-7,16-23".
+static bool cpu_list_has(const char *path, int cpu) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    bool found = false;
+    int lo, hi;
+    char sep;
+    while (!found && fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1) {
+                break;
+            }
+            fscanf(f, "%c", &sep);
+        }
+        found = cpu >= lo && cpu <= hi;
+    }
+    fclose(f);
+    return found;
 }
 
 
-static void mem_write_test_x86asm_nt_x8(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t) / 8;
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "movq %[mem], %%rdx\n\t"
-        "movq %[len], %%rcx\n\t"
-    "1:\n\t"
-        "movnti %[v], (%%rdx)\n\t"
-        "movnti %[v], 8(%%rdx)\n\t"
-        "movnti %[v], 16(%%rdx)\n\t"
-        "movnti %[v], 24(%%rdx)\n\t"
-        "movnti %[v], 32(%%rdx)\n\t"
-        "movnti %[v], 40(%%rdx)\n\t"
-        "movnti %[v], 48(%%rdx)\n\t"
-        "movnti %[v], 56(%%rdx)\n\t"
-        "addq $64, %%rdx\n\t"
-        "dec %%rcx\n\t"
-        "jnz 1b\n\t"
-        "sfence\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "rcx", "rdx", "memory"
-    );
+// Core type of a hybrid part: Intel P/E cores from the split PMUs, otherwise
+// the Arm scheduler capacity, or "-" when neither is exposed.
+static void read_cpu_type(int cpu, char *buf, size_t size) {
+    snprintf(buf, size, "-");
+    if (cpu < 0) {
+        return;
+    }
+    if (cpu_list_has("/sys/devices/cpu_core/cpus", cpu)) {
+        snprintf(buf, size, "P-core");
+    } else if (cpu_list_has("/sys/devices/cpu_atom/cpus", cpu)) {
+        snprintf(buf, size, "E-core");
+    } else {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+        FILE *f = fopen(path, "r");
+        long capacity;
+        if (f != NULL) {
+            if (fscanf(f, "%ld", &capacity) == 1) {
+                snprintf(buf, size, "cap %ld", capacity);
+            }
+            fclose(f);
+        }
+    }
 }
 
 
-static void mem_write_test_x86asm_x8(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t) / 8;
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "movq %[mem], %%rdx\n\t"
-        "movq %[len], %%rcx\n\t"
-    "1:\n\t"
-        "movq %[v], (%%rdx)\n\t"
-        "movq %[v], 8(%%rdx)\n\t"
-        "movq %[v], 16(%%rdx)\n\t"
-        "movq %[v], 24(%%rdx)\n\t"
-        "movq %[v], 32(%%rdx)\n\t"
-        "movq %[v], 40(%%rdx)\n\t"
-        "movq %[v], 48(%%rdx)\n\t"
-        "movq %[v], 56(%%rdx)\n\t"
-        "addq $64, %%rdx\n\t"
-        "dec %%rcx\n\t"
-        "jnz 1b\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "rcx", "rdx", "memory"
-    );
+static void soak_init(soak_state_t *soak, double duration, double interval) {
+    memset(soak, 0, sizeof(*soak));
+    soak->duration = duration;
+    soak->interval = interval;
+    glob("/sys/class/hwmon/hwmon*/temp*_input", 0, NULL, &soak->temp_paths);
+    glob("/sys/class/thermal/thermal_zone*/temp", GLOB_APPEND, NULL, &soak->temp_paths);
 }
 
 
-static void mem_write_test_x86asm_nt_x32(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t) / 32;
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "movq %[mem], %%rdx\n\t"
-        "movq %[len], %%rcx\n\t"
-    "1:\n\t"
-        "movnti %[v], (%%rdx)\n\t"
-        "movnti %[v], 8(%%rdx)\n\t"
-        "movnti %[v], 16(%%rdx)\n\t"
-        "movnti %[v], 24(%%rdx)\n\t"
-        "movnti %[v], 32(%%rdx)\n\t"
-        "movnti %[v], 40(%%rdx)\n\t"
-        "movnti %[v], 48(%%rdx)\n\t"
-        "movnti %[v], 56(%%rdx)\n\t"
-        "movnti %[v], 64(%%rdx)\n\t"
-        "movnti %[v], 72(%%rdx)\n\t"
-        "movnti %[v], 80(%%rdx)\n\t"
-        "movnti %[v], 88(%%rdx)\n\t"
-        "movnti %[v], 96(%%rdx)\n\t"
-        "movnti %[v], 104(%%rdx)\n\t"
-        "movnti %[v], 112(%%rdx)\n\t"
-        "movnti %[v], 120(%%rdx)\n\t"
-        "movnti %[v], 128(%%rdx)\n\t"
-        "movnti %[v], 136(%%rdx)\n\t"
-        "movnti %[v], 144(%%rdx)\n\t"
-        "movnti %[v], 152(%%rdx)\n\t"
-        "movnti %[v], 160(%%rdx)\n\t"
-        "movnti %[v], 168(%%rdx)\n\t"
-        "movnti %[v], 176(%%rdx)\n\t"
-        "movnti %[v], 184(%%rdx)\n\t"
-        "movnti %[v], 192(%%rdx)\n\t"
-        "movnti %[v], 200(%%rdx)\n\t"
-        "movnti %[v], 208(%%rdx)\n\t"
-        "movnti %[v], 216(%%rdx)\n\t"
-        "movnti %[v], 224(%%rdx)\n\t"
-        "movnti %[v], 232(%%rdx)\n\t"
-        "movnti %[v], 240(%%rdx)\n\t"
-        "movnti %[v], 248(%%rdx)\n\t"
-        "addq $256, %%rdx\n\t"
-        "dec %%rcx\n\t"
-        "jnz 1b\n\t"
-        "sfence\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "rcx", "rdx", "memory"
-    );
+static void soak_start(soak_state_t *soak, double start_time) {
+    soak->end_time = start_time + soak->duration;
+    soak->next_time = start_time + soak->interval;
+    soak->last_time = start_time;
+    soak->last_sz = 0;
 }
 
 
-static void mem_write_test_x86asm_x32(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t) / 32;
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "movq %[mem], %%rdx\n\t"
-        "movq %[len], %%rcx\n\t"
-    "1:\n\t"
-        "movq %[v], (%%rdx)\n\t"
-        "movq %[v], 8(%%rdx)\n\t"
-        "movq %[v], 16(%%rdx)\n\t"
-        "movq %[v], 24(%%rdx)\n\t"
-        "movq %[v], 32(%%rdx)\n\t"
-        "movq %[v], 40(%%rdx)\n\t"
-        "movq %[v], 48(%%rdx)\n\t"
-        "movq %[v], 56(%%rdx)\n\t"
-        "movq %[v], 64(%%rdx)\n\t"
-        "movq %[v], 72(%%rdx)\n\t"
-        "movq %[v], 80(%%rdx)\n\t"
-        "movq %[v], 88(%%rdx)\n\t"
-        "movq %[v], 96(%%rdx)\n\t"
-        "movq %[v], 104(%%rdx)\n\t"
-        "movq %[v], 112(%%rdx)\n\t"
-        "movq %[v], 120(%%rdx)\n\t"
-        "movq %[v], 128(%%rdx)\n\t"
-        "movq %[v], 136(%%rdx)\n\t"
-        "movq %[v], 144(%%rdx)\n\t"
-        "movq %[v], 152(%%rdx)\n\t"
-        "movq %[v], 160(%%rdx)\n\t"
-        "movq %[v], 168(%%rdx)\n\t"
-        "movq %[v], 176(%%rdx)\n\t"
-        "movq %[v], 184(%%rdx)\n\t"
-        "movq %[v], 192(%%rdx)\n\t"
-        "movq %[v], 200(%%rdx)\n\t"
-        "movq %[v], 208(%%rdx)\n\t"
-        "movq %[v], 216(%%rdx)\n\t"
-        "movq %[v], 224(%%rdx)\n\t"
-        "movq %[v], 232(%%rdx)\n\t"
-        "movq %[v], 240(%%rdx)\n\t"
-        "movq %[v], 248(%%rdx)\n\t"
-        "addq $256, %%rdx\n\t"
-        "dec %%rcx\n\t"
-        "jnz 1b\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "rcx", "rdx", "memory"
-    );
+static void soak_free(soak_state_t *soak) {
+    globfree(&soak->temp_paths);
+    free(soak->samples);
 }
-#endif  // x86_64
 
 
-#ifdef __AVX2__
-static void mem_write_test_avx2_nt(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+static void soak_sample(soak_state_t *soak, ms_ctx_t *ctx, double t) {
+    if (soak->count == soak->capacity) {
+        soak->capacity = soak->capacity ? soak->capacity * 2 : 64;
+        soak->samples = realloc(soak->samples, soak->capacity * sizeof(soak_sample_t));
+        if (soak->samples == NULL) {
+            fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    soak_sample_t *s = &soak->samples[soak->count++];
+    s->time = t - ctx->start_time;
+    s->bandwidth = (ctx->transferred - soak->last_sz) / (t - soak->last_time);
+    double mhz_sum = 0;
+    int mhz_n = 0;
+    for (size_t i = 0; i < ctx->threads; i++) {
+        // Single threaded runs are not pinned, but are sampled from the
+        // benchmarking thread itself.
+        int cpu = 0;
+        if (ctx->threads > 1 && ctx->thread_cpus != NULL) {
+            cpu = ctx->thread_cpus[i];
+#ifdef __linux__
+        } else {
+            cpu = sched_getcpu();
+#endif
+        }
+        double mhz = read_cpu_mhz(cpu);
+        if (mhz > 0) {
+            mhz_sum += mhz;
+            mhz_n++;
+        }
+    }
+    s->cpu_mhz = mhz_n ? mhz_sum / mhz_n : -1;
+    s->temp_c = read_max_temp_c(&soak->temp_paths);
+    soak->last_sz = ctx->transferred;
+    soak->last_time = t;
+    printf("\r%80s\r", "");
+    printf("[%8.0f s]  %10s/s  |  CPU: ", s->time, human_size(s->bandwidth));
+    if (s->cpu_mhz > 0) {
+        printf("%5.0f MHz", s->cpu_mhz);
+    } else {
+        printf("  n/a");
     }
-    const __m256i vec = _mm256_set1_epi64x(v);
-    __m256i *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(__m256i); i++) {
-         _mm256_stream_si256(mem + i, vec);
+    printf("  |  Temp: ");
+    if (s->temp_c > -1000) {
+        printf("%5.1f C\n", s->temp_c);
+    } else {
+        printf("n/a\n");
     }
-    _mm_sfence();
+    fflush(stdout);
 }
 
 
-static void mem_write_test_avx2(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+// Called after every pass; takes interval samples and stops the run once
+// the soak duration has elapsed.
+static void maybe_sample_soak(soak_state_t *soak, ms_ctx_t *ctx) {
+    if (soak == NULL) {
+        return;
+    }
+    if (soak->end_time == 0) {
+        soak_start(soak, ctx->start_time);
+    }
+    double t = ms_time();
+    if (t >= soak->next_time) {
+        soak_sample(soak, ctx, t);
+        while (soak->next_time <= t) {
+            soak->next_time += soak->interval;
+        }
     }
-    const __m256i vec = _mm256_set1_epi64x(v);
-    __m256i *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(__m256i); i++) {
-         _mm256_store_si256(mem + i, vec);
+    if (t >= soak->end_time) {
+        atomic_store(&ctx->stop, true);
     }
 }
 
 
-# ifdef __AVX512F__
-static void mem_write_test_avx512_nt(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+// Initial is the first interval; sustained is the mean of the last quarter
+// of intervals, by which point most coolers have reached steady state.
+static void print_soak_summary(soak_state_t *soak) {
+    if (soak->count == 0) {
+        printf("Soak: no complete intervals recorded\n");
+        return;
+    }
+    soak_sample_t *first = &soak->samples[0];
+    size_t tail_start = soak->count - MAX(1, soak->count / 4);
+    double min = first->bandwidth;
+    double max = first->bandwidth;
+    double peak_temp = first->temp_c;
+    soak_sample_t sustained = {0};
+    for (size_t i = 0; i < soak->count; i++) {
+        soak_sample_t *s = &soak->samples[i];
+        min = MIN(min, s->bandwidth);
+        max = MAX(max, s->bandwidth);
+        peak_temp = MAX(peak_temp, s->temp_c);
+        if (i >= tail_start) {
+            sustained.bandwidth += s->bandwidth / (soak->count - tail_start);
+            sustained.cpu_mhz += s->cpu_mhz / (soak->count - tail_start);
+            sustained.temp_c += s->temp_c / (soak->count - tail_start);
+        }
+    }
+    printf("Soak intervals: %zu x %.0f s\n", soak->count, soak->interval);
+    printf("Initial speed: %s/s\n", human_size(first->bandwidth));
+    printf("Sustained speed: %s/s\n", human_size(sustained.bandwidth));
+    printf("Min/Max speed: %s/s / %s/s\n", human_size(min), human_size(max));
+    printf("Decay: %.1f%%\n", (first->bandwidth - sustained.bandwidth) / first->bandwidth * 100);
+    if (first->cpu_mhz > 0) {
+        printf("CPU freq: %.0f MHz -> %.0f MHz\n", first->cpu_mhz, sustained.cpu_mhz);
     }
-    const __m512i vec = _mm512_set1_epi64(v);
-    __m512i *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(__m512i); i++) {
-         _mm512_stream_si512(mem + i, vec);
+    if (peak_temp > -1000) {
+        printf("Temp: %.1f C -> %.1f C (peak %.1f C)\n", first->temp_c, sustained.temp_c, peak_temp);
     }
-    _mm_sfence();
 }
 
 
-static void mem_write_test_avx512(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+#define STATS_WINDOW 0.100
+
+
+static void maybe_sample_stats(ms_ctx_t *ctx, stats_state_t *stats) {
+    if (stats->last_time == 0) {
+        stats->last_time = ctx->start_time;
     }
-    const __m512i vec = _mm512_set1_epi64(v);
-    __m512i *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(__m512i); i++) {
-         _mm512_store_si512(mem + i, vec);
+    double t = ms_time();
+    if (t - stats->last_time < STATS_WINDOW) {
+        return;
+    }
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 256;
+        stats->samples = realloc(stats->samples, stats->capacity * sizeof(double));
+        if (stats->samples == NULL) {
+            fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
+            exit(1);
+        }
     }
+    stats->samples[stats->count++] = (ctx->transferred - stats->last_sz) / (t - stats->last_time);
+    stats->last_sz = ctx->transferred;
+    stats->last_time = t;
 }
-# endif  // avx512
-#endif  // avx2
 
 
-#ifdef __aarch64__
-static void mem_write_test_armasm(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t);
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "mov x0, %[mem]\n\t"
-        "mov x1, %[len]\n\t"
-    "1: \n\t"
-        "stp %[v], %[v], [x0]\n\t"
-        "add x0, x0, #16\n\t"
-        "subs x1, x1, #2\n\t"
-        "b.gt 1b\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "x0", "x1", "memory"
-    );
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
 }
 
 
-static void mem_write_test_armasm_x8(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t);
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "mov x0, %[mem]\n\t"
-        "mov x1, %[len]\n\t"
-    "1: \n\t"
-        "stp %[v], %[v], [x0]\n\t"
-        "stp %[v], %[v], [x0, #16]\n\t"
-        "stp %[v], %[v], [x0, #32]\n\t"
-        "stp %[v], %[v], [x0, #48]\n\t"
-        "stp %[v], %[v], [x0, #64]\n\t"
-        "stp %[v], %[v], [x0, #80]\n\t"
-        "stp %[v], %[v], [x0, #96]\n\t"
-        "stp %[v], %[v], [x0, #112]\n\t"
-        "add x0, x0, #128\n\t"
-        "subs x1, x1, #16\n\t"
-        "b.gt 1b\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "x0", "x1", "memory"
-    );
+// Runs shorter than two windows fall back to the overall average.
+static bw_stats_t compute_stats(stats_state_t *stats, size_t transferred, double time) {
+    bw_stats_t r = {.avg = transferred / time, .samples = stats->count};
+    if (stats->count < 2) {
+        r.median = r.min = r.max = r.avg;
+        return r;
+    }
+    qsort(stats->samples, stats->count, sizeof(double), cmp_double);
+    size_t n = stats->count;
+    r.min = stats->samples[0];
+    r.max = stats->samples[n - 1];
+    r.median = n % 2 ? stats->samples[n / 2] :
+        (stats->samples[n / 2 - 1] + stats->samples[n / 2]) / 2;
+    double mean = 0;
+    for (size_t i = 0; i < n; i++) {
+        mean += stats->samples[i] / n;
+    }
+    double var = 0;
+    for (size_t i = 0; i < n; i++) {
+        var += (stats->samples[i] - mean) * (stats->samples[i] - mean) / (n - 1);
+    }
+    r.stdev = sqrt(var);
+    return r;
 }
 
 
-static void mem_write_test_armasm_nt(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t);
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "mov x0, %[mem]\n\t"
-        "mov x1, %[len]\n\t"
-    "1: \n\t"
-        "stnp %[v], %[v], [x0]\n\t"
-        "add x0, x0, #16\n\t"
-        "subs x1, x1, #2\n\t"
-        "b.gt 1b\n\t"
-        "dsb ishst\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "x0", "x1", "memory"
-    );
+static void print_stats(bw_stats_t *stats) {
+    printf("Speed stats (%zu x %.0f ms windows): min %s/s  |  median %s/s  |  max %s/s  |  stdev %s/s\n",
+        stats->samples, STATS_WINDOW * 1000, human_size(stats->min), human_size(stats->median),
+        human_size(stats->max), human_size(stats->stdev));
 }
 
 
-static void mem_write_test_armasm_nt_x8(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    size_t len = size / sizeof(uint64_t);
-    uint64_t *mem = ptr;
-    __asm__ __volatile__(
-        "mov x0, %[mem]\n\t"
-        "mov x1, %[len]\n\t"
-    "1: \n\t"
-        "stnp %[v], %[v], [x0]\n\t"
-        "stnp %[v], %[v], [x0, #16]\n\t"
-        "stnp %[v], %[v], [x0, #32]\n\t"
-        "stnp %[v], %[v], [x0, #48]\n\t"
-        "stnp %[v], %[v], [x0, #64]\n\t"
-        "stnp %[v], %[v], [x0, #80]\n\t"
-        "stnp %[v], %[v], [x0, #96]\n\t"
-        "stnp %[v], %[v], [x0, #112]\n\t"
-        "add x0, x0, #128\n\t"
-        "subs x1, x1, #16\n\t"
-        "b.gt 1b\n\t"
-        "dsb ishst\n\t"
-        :
-        : [mem] "r" (mem),
-          [len] "r" (len),
-          [v] "r" (v)
-        : "x0", "x1", "memory"
-    );
+static void format_cpus(ms_ctx_t *ctx, char *buf, size_t size) {
+    buf[0] = '\0';
+    if (ctx->thread_cpus == NULL || ctx->threads < 2) {
+        snprintf(buf, size, "any");
+        return;
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < ctx->threads && len < size; i++) {
+        len += snprintf(buf + len, size - len, i ? ",%d" : "%d", ctx->thread_cpus[i]);
+    }
 }
-#endif  // aarch64
 
 
-#ifdef __ARM_NEON
-void mem_write_test_armneon(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+// Baselines are plain key=value lines so they diff and review cleanly.
+static void save_baseline(const char *path, baseline_t *b) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open baseline %s: %s\n", path, strerror(errno));
+        exit(1);
     }
-    uint64x2_t vec = vdupq_n_u64(v);
-    uint64x2_t *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(uint64x2_t); i++) {
-        vst1q_u64((uint64_t*) (mem + i), vec);
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    fprintf(f, "# memspeed baseline from %s\n", host);
+    fprintf(f, "version=1\n");
+    fprintf(f, "strategy=%s\n", b->strategy);
+    fprintf(f, "buffer_size=%zu\n", b->buffer_size);
+    fprintf(f, "transfer_size=%zu\n", b->transfer_size);
+    fprintf(f, "threads=%zu\n", b->threads);
+    fprintf(f, "source=%s\n", b->source);
+    fprintf(f, "pages=%s\n", b->pages);
+    fprintf(f, "sched=%s\n", b->sched);
+    fprintf(f, "chunk_size=%zu\n", b->chunk_size);
+    fprintf(f, "layout=%s\n", b->layout);
+    fprintf(f, "block_size=%zu\n", b->block_size);
+    fprintf(f, "offset=%zu\n", b->offset);
+    fprintf(f, "batch=%zu\n", b->batch);
+    fprintf(f, "cpus=%s\n", b->cpus);
+    fprintf(f, "avg=%.0f\n", b->stats.avg);
+    fprintf(f, "median=%.0f\n", b->stats.median);
+    fprintf(f, "min=%.0f\n", b->stats.min);
+    fprintf(f, "max=%.0f\n", b->stats.max);
+    fprintf(f, "stdev=%.0f\n", b->stats.stdev);
+    fprintf(f, "samples=%zu\n", b->stats.samples);
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Failed to write baseline %s: %s\n", path, strerror(errno));
+        exit(1);
     }
 }
-#endif  // arm_neon
 
 
-static void mem_write_test_c(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+static void load_baseline(const char *path, baseline_t *b) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open baseline %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    memset(b, 0, sizeof(*b));
+    char line[1200];
+    int version = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *val = strchr(line, '=');
+        if (line[0] == '#' || val == NULL) {
+            continue;
+        }
+        *val++ = '\0';
+        if (strcmp(line, "version") == 0) {
+            version = atoi(val);
+        } else if (strcmp(line, "strategy") == 0) {
+            snprintf(b->strategy, sizeof(b->strategy), "%s", val);
+        } else if (strcmp(line, "buffer_size") == 0) {
+            b->buffer_size = str_to_pos_u64(val);
+        } else if (strcmp(line, "transfer_size") == 0) {
+            b->transfer_size = str_to_pos_u64(val);
+        } else if (strcmp(line, "threads") == 0) {
+            b->threads = str_to_pos_u64(val);
+        } else if (strcmp(line, "pages") == 0) {
+            snprintf(b->pages, sizeof(b->pages), "%s", val);
+        } else if (strcmp(line, "source") == 0) {
+            snprintf(b->source, sizeof(b->source), "%s", val);
+        } else if (strcmp(line, "sched") == 0) {
+            snprintf(b->sched, sizeof(b->sched), "%s", val);
+        } else if (strcmp(line, "chunk_size") == 0) {
+            b->chunk_size = strtoull(val, NULL, 10);
+        } else if (strcmp(line, "layout") == 0) {
+            snprintf(b->layout, sizeof(b->layout), "%s", val);
+        } else if (strcmp(line, "block_size") == 0) {
+            b->block_size = strtoull(val, NULL, 10);
+        } else if (strcmp(line, "offset") == 0) {
+            b->offset = strtoull(val, NULL, 10);
+        } else if (strcmp(line, "batch") == 0) {
+            b->batch = strtoull(val, NULL, 10);
+        } else if (strcmp(line, "cpus") == 0) {
+            snprintf(b->cpus, sizeof(b->cpus), "%s", val);
+        } else if (strcmp(line, "avg") == 0) {
+            b->stats.avg = str_to_pos_double(val);
+        } else if (strcmp(line, "median") == 0) {
+            b->stats.median = str_to_pos_double(val);
+        } else if (strcmp(line, "min") == 0) {
+            b->stats.min = str_to_pos_double(val);
+        } else if (strcmp(line, "max") == 0) {
+            b->stats.max = str_to_pos_double(val);
+        } else if (strcmp(line, "stdev") == 0) {
+            b->stats.stdev = str_to_pos_double(val);
+        } else if (strcmp(line, "samples") == 0) {
+            b->stats.samples = str_to_pos_u64(val);
+        }
+    }
+    fclose(f);
+    // Older baselines predate these settings and ran with their defaults.
+    if (!b->pages[0]) {
+        snprintf(b->pages, sizeof(b->pages), "base");
+    }
+    if (!b->sched[0]) {
+        snprintf(b->sched, sizeof(b->sched), "static");
     }
-    uint64_t *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
-        mem[i] = v;
+    if (!b->layout[0]) {
+        snprintf(b->layout, sizeof(b->layout), "contiguous");
+    }
+    if (version != 1 || !b->strategy[0] || !b->source[0] || !b->buffer_size || !b->transfer_size ||
+        !b->threads || !b->stats.avg) {
+        fprintf(stderr, "Invalid baseline file: %s\n", path);
+        exit(1);
+    }
+}
+
+
+// The baseline's run settings win over the command line; say so when one was
+// set to something else than its default.
+static void warn_baseline_override(const char *key, const char *cur, const char *def, const char *base) {
+    if (strcmp(cur, def) != 0 && strcmp(cur, base) != 0) {
+        fprintf(stderr, "WARNING: Baseline runs with %s %s, not %s\n", key, base, cur);
     }
 }
 
 
-static void mem_write_test_c_x8(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+// Pin to the CPUs the baseline ran on so placement matches.  The library
+// maps threads over the affinity set in ascending order, which is also the
+// order the baseline recorded them in.
+static void apply_baseline_cpus(baseline_t *b) {
+#ifdef __linux__
+    if (strcmp(b->cpus, "any") == 0) {
+        return;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    char cpus[sizeof(b->cpus)];
+    snprintf(cpus, sizeof(cpus), "%s", b->cpus);
+    for (char *tok = strtok(cpus, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        CPU_SET(str_to_pos_u64(tok), &cpuset);
     }
-    uint64_t *mem = ptr;
-    for (size_t i = 0; i < size / sizeof(uint64_t); i += 8) {
-        mem[i] = v;
-        mem[i + 1] = v;
-        mem[i + 2] = v;
-        mem[i + 3] = v;
-        mem[i + 4] = v;
-        mem[i + 5] = v;
-        mem[i + 6] = v;
-        mem[i + 7] = v;
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+        fprintf(stderr, "WARNING: Unable to use baseline CPUs %s: %s\n", b->cpus, strerror(errno));
     }
+#else
+    (void) b;
+#endif
 }
 
 
-static void mem_write_test_c_x32(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
+// Every bandwidth metric is higher-is-better; stdev is informational only.
+// min and max are single windows, the noisiest stats, so they are only gated
+// against their own extreme_threshold when one is given.
+static bool compare_baseline(baseline_t *base, baseline_t *cur, double threshold, double extreme_threshold) {
+    struct { const char *name; double base; double cur; double limit; } metrics[] = {
+        {"avg", base->stats.avg, cur->stats.avg, threshold},
+        {"median", base->stats.median, cur->stats.median, threshold},
+        {"min", base->stats.min, cur->stats.min, extreme_threshold},
+        {"max", base->stats.max, cur->stats.max, extreme_threshold},
+        {"stdev", base->stats.stdev, cur->stats.stdev, 0},
+    };
+    if (strcmp(base->cpus, cur->cpus) != 0) {
+        printf("WARNING: CPU placement differs from baseline: %s vs %s\n", cur->cpus, base->cpus);
+    }
+    bool pass = true;
+    printf("%-8s %14s %14s %9s\n", "Metric", "Baseline", "Current", "Delta");
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+        char base_s[32];
+        char cur_s[32];
+        snprintf(base_s, sizeof(base_s), "%s/s", human_size(metrics[i].base));
+        snprintf(cur_s, sizeof(cur_s), "%s/s", human_size(metrics[i].cur));
+        double delta = metrics[i].base ? (metrics[i].cur - metrics[i].base) / metrics[i].base * 100 : 0;
+        bool fail = metrics[i].limit > 0 && delta < -metrics[i].limit;
+        printf("%-8s %14s %14s %+8.1f%%%s\n", metrics[i].name, base_s, cur_s, delta,
+            fail ? "  REGRESSION" : "");
+        pass &= !fail;
     }
-    uint64_t *m = ptr;
-    for (size_t i = 0; i < size / sizeof(uint64_t); i += 32) {
-        m[i]    = v; m[i+1]  = v; m[i+2]  = v; m[i+3]  = v; m[i+4]  = v; m[i+5]  = v; m[i+6]  = v; m[i+7]  = v;
-        m[i+8]  = v; m[i+9]  = v; m[i+10] = v; m[i+11] = v; m[i+12] = v; m[i+13] = v; m[i+14] = v; m[i+15] = v;
-        m[i+16] = v; m[i+17] = v; m[i+18] = v; m[i+19] = v; m[i+20] = v; m[i+21] = v; m[i+22] = v; m[i+23] = v;
-        m[i+24] = v; m[i+25] = v; m[i+26] = v; m[i+27] = v; m[i+28] = v; m[i+29] = v; m[i+30] = v; m[i+31] = v;
+    printf("\nRESULT: %s (threshold %.1f%%", pass ? "PASS" : "FAIL", threshold);
+    if (extreme_threshold > 0) {
+        printf(", min/max %.1f%%", extreme_threshold);
     }
+    printf(")\n");
+    return pass;
 }
 
 
-static void mem_write_test_c_x128(void *ptr, size_t size, size_t iter) {
-    const uint64_t b = iter % 0xff;
-    uint64_t v = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); i++) {
-        v = (v << 8) | b;
-    }
-    uint64_t *m = ptr;
-    for (size_t i = 0; i < size / sizeof(uint64_t);) {
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
-        m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v; m[i++] = v;
+static void maybe_draw_progress(ms_ctx_t *ctx, draw_state_t *state) {
+    if (state->last_time == 0) {
+        state->last_time = ctx->start_time;
+    }
+    int draw = 0;
+    for (; state->ticks * GB < ctx->transferred; state->ticks++) {
+        draw = 1;
+    }
+    if (draw) {
+        double t = ms_time();
+        double elapsed = t - state->last_time;
+        if (elapsed > 0.200) {
+            printf("\r%80s\r", "");
+            printf("\rCurrent: %10s/s  |  Avg: %10s/s  |  Transferred: %s",
+                human_size((ctx->transferred - state->last_sz) / (t - state->last_time)),
+                human_size(ctx->transferred / (t - ctx->start_time)),
+                human_size(ctx->transferred));
+            fflush(stdout);
+            state->last_sz = ctx->transferred;
+            state->last_time = t;
+        }
     }
 }
 
 
-static void mem_write_test_memset(void *ptr, size_t size, size_t iter) {
-    const char b = iter % 0xff;
-    memset(ptr, b, size);
+static void on_progress(ms_ctx_t *ctx, void *arg) {
+    progress_state_t *state = arg;
+    maybe_draw_progress(ctx, &state->draw);
+    maybe_sample_soak(state->soak, ctx);
+    maybe_sample_stats(ctx, &state->stats);
 }
 
 
-static void mem_write_test_memcpy(void *ptr, size_t size, size_t iter) {
-    char * restrict scratch = aligned_alloc(g_page_size, g_page_size);
-    if (scratch == NULL) {
-        fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
-        exit(1);
+// Each test runs with base pages and then the huge page flavor in use.
+static void run_fault_mode(ms_ctx_t *ctx, ms_buffer_t *tmpl, size_t rounds) {
+    ms_pages_t kinds[] = {MS_PAGES_BASE, tmpl->pages == MS_PAGES_BASE ? MS_PAGES_THP : tmpl->pages};
+    printf("%-12s %-10s %16s %16s %14s\n", "Pages", "Test", "Per thread", "Aggregate", "Speed");
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        for (ms_fault_test_t test = 0; test < MS_FAULT_TESTS; test++) {
+            ms_buffer_t buf = *tmpl;
+            buf.pages = kinds[k];
+            ms_fault_result_t r;
+            char label[32];
+            snprintf(label, sizeof(label), "%s %s", human_size(
+                kinds[k] == MS_PAGES_BASE ? ctx->page_size : ms_huge_page_size()),
+                kinds[k] == MS_PAGES_BASE ? "" : ms_pages_name(kinds[k]));
+            if (ms_fault_bench(ctx, &buf, test, rounds, &r) != 0) {
+                printf("%-12s %-10s %s\n", label, ms_fault_test_name(test), ms_error(ctx));
+                continue;
+            }
+            char per_thread[32];
+            char aggregate[32];
+            snprintf(per_thread, sizeof(per_thread), "%spages/s", human_count(r.thread_rate));
+            snprintf(aggregate, sizeof(aggregate), "%spages/s", human_count(r.pages / r.time));
+            printf("%-12s %-10s %16s %16s %12s/s\n", label, ms_fault_test_name(test), per_thread,
+                aggregate, human_size(r.pages * r.page_size / r.time));
+            fflush(stdout);
+        }
     }
-    const char b = iter % 0xff;
-    memset(scratch, b, g_page_size);
-    char *mem = ptr;
-    for (size_t i = 0; i < size; i += g_page_size) {
-        memcpy(mem + i, scratch, g_page_size);
+}
+
+
+#define COPY_MIN_BYTES (128 * MB)
+#define COPY_SMALL_MAX (64 * 1024)
+
+
+// One table per src/dst misalignment.  Copies up to COPY_SMALL_MAX report ns
+// per copy, larger ones GB/s, and the largest is half the buffer.
+static void run_copy_mode(ms_ctx_t *ctx, void *mem, size_t size) {
+    static const size_t aligns[][2] = {{0, 0}, {8, 8}, {0, 1}, {1, 0}};
+    const size_t half = size / 2;
+    const size_t max_copy = half - 64;
+    for (size_t a = 0; a < sizeof(aligns) / sizeof(aligns[0]); a++) {
+        char *src = (char*) mem + aligns[a][0];
+        char *dst = (char*) mem + half + aligns[a][1];
+        printf("\nsrc+%zu -> dst+%zu\n%-10s", aligns[a][0], aligns[a][1], "Size");
+        for (const ms_copy_impl_t *c = ms_copy_impls(); c->name != NULL; c++) {
+            printf(" %12s", c->name);
+        }
+        printf("\n");
+        for (size_t n = 16; n <= max_copy; n *= n < COPY_SMALL_MAX ? 2 : 4) {
+            printf("%-10s", human_size(n));
+            for (const ms_copy_impl_t *c = ms_copy_impls(); c->name != NULL; c++) {
+                ms_copy_result_t r;
+                if (ms_copy_bench(ctx, c, dst, src, n, COPY_MIN_BYTES, &r) != 0) {
+                    fprintf(stderr, "%s\n", ms_error(ctx));
+                    exit(1);
+                }
+                if (n <= COPY_SMALL_MAX) {
+                    printf(" %9.1f ns", r.time / r.copies * 1e9);
+                } else {
+                    printf(" %10s/s", human_size(n * r.copies / r.time));
+                }
+                fflush(stdout);
+            }
+            printf("\n");
+        }
     }
-    free(scratch);
 }
 
 
-#ifdef __linux__
-static cpus_topology_t * get_cpus_topology() {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    sched_getaffinity(0, sizeof(cpuset), &cpuset); // has ambiguous return value
-    int count = CPU_COUNT(&cpuset);
-    if (count < 1 || count > 0xffff) {
-        errno = ENOENT;
-        return NULL;
+#define ALIGN_MIN_BYTES (1UL * GB)
+#define ALIGN_MIN_ACCESSES (16UL * 1024 * 1024)
+
+
+// Streaming loads and stores of every vector width from each start offset in
+// 0..63, then one access per page placed aligned, across a line and across
+// the page boundary.
+static void run_align_mode(ms_ctx_t *ctx, void *mem, size_t size, size_t step) {
+    printf("\nStreaming from buffer + offset, GB/s\n%-8s", "Offset");
+    for (const ms_align_impl_t *a = ms_align_impls(); a->name != NULL; a++) {
+        printf(" %10s ld %10s st", a->name, a->name);
     }
-    cpus_topology_t *topo = malloc(sizeof(cpus_topology_t));
-    if (topo == NULL) {
-        return NULL;
+    printf("\n");
+    for (size_t offset = 0; offset < MS_CACHE_LINE; offset += step) {
+        printf("%-8zu", offset);
+        for (const ms_align_impl_t *a = ms_align_impls(); a->name != NULL; a++) {
+            for (int store = 0; store <= 1; store++) {
+                ms_align_result_t r;
+                if (ms_align_bench(ctx, a, store, (char*) mem + offset, (size - MS_CACHE_LINE) / a->width,
+                                   a->width, ALIGN_MIN_BYTES / a->width, &r) != 0) {
+                    fprintf(stderr, "%s\n", ms_error(ctx));
+                    exit(1);
+                }
+                printf(" %11s/s", human_size(r.accesses * a->width / r.time));
+                fflush(stdout);
+            }
+        }
+        printf("\n");
     }
-    topo->cpus = calloc(count, sizeof(topo->cpus[0]));
-    if (topo->cpus == NULL) {
-        free(topo);
-        return NULL;
+
+    const size_t pages = size / ctx->page_size - 1;
+    printf("\nOne access per %s page, ns per access\n%-11s", human_size(ctx->page_size), "Placement");
+    for (const ms_align_impl_t *a = ms_align_impls(); a->name != NULL; a++) {
+        printf(" %10s ld %10s st", a->name, a->name);
     }
-    topo->count = count;
-    for (int cpu = 0, i = 0; cpu < CPU_SETSIZE; cpu++) {
-        if (CPU_ISSET(cpu, &cpuset)) {
-            topo->cpus[i++] = cpu;
+    printf("\n");
+    for (int place = 0; place < 3; place++) {
+        static const char *place_names[] = {"aligned", "line split", "page split"};
+        printf("%-11s", place_names[place]);
+        for (const ms_align_impl_t *a = ms_align_impls(); a->name != NULL; a++) {
+            const size_t at = place == 0 ? 0 :
+                (place == 1 ? MS_CACHE_LINE : ctx->page_size) - a->width / 2;
+            for (int store = 0; store <= 1; store++) {
+                ms_align_result_t r;
+                if (ms_align_bench(ctx, a, store, (char*) mem + at, pages, ctx->page_size,
+                                   ALIGN_MIN_ACCESSES, &r) != 0) {
+                    fprintf(stderr, "%s\n", ms_error(ctx));
+                    exit(1);
+                }
+                printf(" %13.2f", r.time / r.accesses * 1e9);
+                fflush(stdout);
+            }
         }
+        printf("\n");
     }
-    return topo;
 }
-#endif
 
 
-static void maybe_draw_progress(draw_state_t *state) {
-    int draw = 0;
-    for (; state->ticks * GB < g_transferred; state->ticks++) {
-        draw = 1;
+#define MLP_LOADS (1UL << 24)
+
+
+static void run_mlp_mode(ms_ctx_t *ctx, void *mem, size_t size, size_t max_chains) {
+    ms_mlp_t mlp;
+    printf("Linking random chains...\n");
+    if (ms_mlp_init(ctx, &mlp, mem, size) != 0) {
+        fprintf(stderr, "%s\n", ms_error(ctx));
+        exit(1);
     }
-    if (draw) {
-        double t = get_time();
-        double elapsed = t - state->last_time;
-        if (elapsed > 0.200) {
-            printf("\r%80s\r", "");
-            printf("\rCurrent: %10s/s  |  Avg: %10s/s  |  Transferred: %s",
-                human_size((g_transferred - state->last_sz) / (t - state->last_time)),
-                human_size(g_transferred / (t - g_start_time)),
-                human_size(g_transferred));
-            fflush(stdout);
-            state->last_sz = g_transferred;
-            state->last_time = t;
+    printf("%-7s %14s %16s %14s %7s\n", "Chains", "Latency/chain", "Lines", "Speed", "MLP");
+    double base_rate = 0;
+    double peak_mlp = 0;
+    size_t peak_chains = 1;
+    for (size_t chains = 1; chains <= max_chains; chains++) {
+        ms_mlp_result_t r;
+        if (ms_mlp_run(ctx, &mlp, chains, MLP_LOADS, &r) != 0) {
+            fprintf(stderr, "%s\n", ms_error(ctx));
+            exit(1);
+        }
+        if (chains == 1) {
+            base_rate = r.rate;
         }
+        double mlp_factor = r.rate / base_rate;
+        if (mlp_factor > peak_mlp) {
+            peak_mlp = mlp_factor;
+            peak_chains = chains;
+        }
+        char lines[32];
+        snprintf(lines, sizeof(lines), "%s/s", human_count(r.rate));
+        printf("%-7zu %11.1f ns %16s %12s/s %7.2f\n", chains, r.latency * 1e9, lines,
+            human_size(r.rate * MS_CACHE_LINE), mlp_factor);
+        fflush(stdout);
     }
+    printf("\nPeak MLP: %.1f lines in flight at %zu chains\n", peak_mlp, peak_chains);
+    ms_mlp_destroy(&mlp);
 }
 
 
-static void* threaded_test_runner(void *_options) {
-    thread_options_t *options = _options;
-#ifdef __linux__
-    char name[128];
-    snprintf(name, sizeof(name), "memspeed-%03d", options->id);
-    ZERO_OR_EXIT(prctl(PR_SET_NAME, name));
-#endif
-    ZERO_OR_EXIT(pthread_mutex_lock(options->ready_mut));
-    (*options->ready)++;
-    ZERO_OR_EXIT(pthread_cond_signal(options->ready_cond));
-    ZERO_OR_EXIT(pthread_mutex_unlock(options->ready_mut));
-
-    ZERO_OR_EXIT(pthread_mutex_lock(options->start_mut));
-    ZERO_OR_EXIT(pthread_cond_wait(options->start_cond, options->start_mut));
-    ZERO_OR_EXIT(pthread_mutex_unlock(options->start_mut));
-    for (size_t iter = 1; iter <= options->iterations; iter++) {
-        options->test(options->mem, options->size, iter);
-        ZERO_OR_EXIT(pthread_mutex_lock(options->prog_mut));
-        g_transferred += options->size;
-        if (iter == options->iterations) {
-            (*options->done)++;
-        }
-        ZERO_OR_EXIT(pthread_cond_signal(options->prog_cond));
-        ZERO_OR_EXIT(pthread_mutex_unlock(options->prog_mut));
-    }
-    return NULL;
+// Whether the strategy's write unit divides the ctx->layout blocks.
+static bool layout_fits(const ms_ctx_t *ctx, const ms_strategy_t *strat, size_t shard_size) {
+    const size_t unit = strat->unit > 0 ? strat->unit : ctx->page_size;
+    return ms_layout_block(ctx, shard_size) % unit == 0;
+}
+
+
+// Whether the strategy's stores may start at ctx->offset.
+static bool strategy_fits(const ms_ctx_t *ctx, const ms_strategy_t *strat) {
+    return strat->align == 0 || ctx->offset % strat->align == 0;
 }
 
 
-static void bench_threaded(void *mem, size_t buffer_size, size_t transfer_size, mem_write_test test) {
-    pthread_t *threads = calloc(g_thread_count, sizeof(pthread_t));
-    if (threads == NULL) {
-        fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
+// Bytes written per kernel and size when searching for the NT crossover.
+#define CROSSOVER_BYTES (1 * GB)
+#define CROSSOVER_MIN_SHARD (64 * 1024)
+#define CROSSOVER_MAX_PAIRS 16
+#define CROSSOVER_MAX_SIZES 48
+
+
+static double crossover_speed(ms_ctx_t *ctx, void *mem, size_t size, const ms_strategy_t *strat) {
+    size_t transfer = MAX(CROSSOVER_BYTES, 2 * size) / size * size;
+    int rc = ctx->threads > 1 ?
+        ms_bench_threaded(ctx, mem, size, transfer, strat->test) :
+        ms_bench(ctx, mem, size, transfer, strat->test);
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", ms_error(ctx));
         exit(1);
     }
+    return ctx->transferred / (ctx->end_time - ctx->start_time);
+}
 
-    pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
-    pthread_mutex_t ready_mut = PTHREAD_MUTEX_INITIALIZER;
-    pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
-    pthread_mutex_t start_mut = PTHREAD_MUTEX_INITIALIZER;
-    pthread_cond_t prog_cond = PTHREAD_COND_INITIALIZER;
-    pthread_mutex_t prog_mut = PTHREAD_MUTEX_INITIALIZER;
-    size_t ready = 0;
-    size_t done = 0;
 
-#ifdef __linux__
-    cpus_topology_t *cpus_topo = get_cpus_topology();
-    if (cpus_topo == NULL) {
-        fprintf(stderr, "Failed to get CPU topology: %s", strerror(errno));
+static int compare_size(const void *a, const void *b) {
+    size_t x = *(const size_t*) a;
+    size_t y = *(const size_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+// Pair every _nt strategy with its temporal twin and, for 1, 2, 4 ..
+// max_threads threads, find the smallest shard from which NT stays ahead.
+static void run_crossover_mode(ms_ctx_t *ctx, void *mem, size_t size, size_t max_threads) {
+    const ms_strategy_t *nt[CROSSOVER_MAX_PAIRS];
+    const ms_strategy_t *temporal[CROSSOVER_MAX_PAIRS];
+    size_t pairs = 0;
+    for (const ms_strategy_t *s = ms_strategies(); s->name != NULL && pairs < CROSSOVER_MAX_PAIRS; s++) {
+        const char *suffix = strstr(s->name, "_nt");
+        if (suffix == NULL) {
+            continue;
+        }
+        char twin[64];
+        snprintf(twin, sizeof(twin), "%.*s%s", (int) (suffix - s->name), s->name, suffix + 3);
+        const ms_strategy_t *t = ms_strategy_find(twin);
+        if (t != NULL && strategy_fits(ctx, s) && strategy_fits(ctx, t) &&
+            layout_fits(ctx, s, CROSSOVER_MIN_SHARD) && layout_fits(ctx, t, CROSSOVER_MIN_SHARD)) {
+            nt[pairs] = s;
+            temporal[pairs] = t;
+            pairs++;
+        }
+    }
+    if (pairs == 0) {
+        fprintf(stderr, "No NT strategies built for this CPU\n");
         exit(1);
     }
-    if (g_verbose) {
-        int last_cpu = cpus_topo->cpus[0];
-        printf("Available CPU cores: %d", last_cpu);
-        bool spanning = false;
-        for (int i = 1; i < cpus_topo->count; i++) {
-            int cpu = cpus_topo->cpus[i];
-            if (last_cpu == cpu - 1) {
-                last_cpu = cpu;
-                spanning = true;
-                continue;
+    const size_t saved_threads = ctx->threads;
+    ctx->progress = NULL;
+    for (size_t threads = 1; threads <= max_threads; threads = threads * 2 > max_threads &&
+            threads < max_threads ? max_threads : threads * 2) {
+        ctx->threads = threads;
+        size_t shards[CROSSOVER_MAX_SIZES];
+        double ratios[CROSSOVER_MAX_SIZES][CROSSOVER_MAX_PAIRS];
+        size_t sizes = 0;
+        printf("\nThreads: %zu, NT speed / temporal speed\n%-10s", threads, "Shard");
+        for (size_t p = 0; p < pairs; p++) {
+            printf(" %12s", temporal[p]->name);
+        }
+        printf("\n");
+        for (size_t shard = CROSSOVER_MIN_SHARD; shard * threads <= size && sizes < CROSSOVER_MAX_SIZES;
+                shard *= 2) {
+            shards[sizes] = shard;
+            printf("%-10s", human_size(shard));
+            for (size_t p = 0; p < pairs; p++) {
+                double t = crossover_speed(ctx, mem, shard * threads, temporal[p]);
+                double n = crossover_speed(ctx, mem, shard * threads, nt[p]);
+                ratios[sizes][p] = n / t;
+                printf(" %11.2fx", ratios[sizes][p]);
+                fflush(stdout);
+            }
+            printf("\n");
+            sizes++;
+        }
+        if (sizes == 0) {
+            printf("Buffer too small for %zu threads\n", threads);
+            break;
+        }
+        size_t crossovers[CROSSOVER_MAX_PAIRS];
+        size_t crossed = 0;
+        printf("%-10s", "Crossover");
+        for (size_t p = 0; p < pairs; p++) {
+            size_t k = sizes;
+            while (k > 0 && ratios[k - 1][p] >= 1) {
+                k--;
             }
-            if (spanning) {
-                printf(" -> %d", last_cpu);
+            if (k == sizes) {
+                printf(" %12s", "none");
+            } else {
+                crossovers[crossed++] = shards[k];
+                printf(" %12s", human_size(shards[k]));
             }
-            printf(", %d", cpu);
-            spanning = false;
-            last_cpu = cpu;
         }
-        if (spanning) {
-            printf(" -> %d", cpus_topo->cpus[cpus_topo->count - 1]);
+        printf("\n");
+        if (crossed == 0) {
+            printf("Recommended threshold: none, NT never wins up to %s per thread\n",
+                human_size(shards[sizes - 1]));
+            continue;
+        }
+        qsort(crossovers, crossed, sizeof(crossovers[0]), compare_size);
+        size_t threshold = crossovers[crossed / 2];
+        printf("Recommended threshold: %s per thread (median of %zu/%zu pairs)\n",
+            human_size(threshold), crossed, pairs);
+#ifdef __x86_64__
+        printf("GLIBC_TUNABLES=glibc.cpu.x86_non_temporal_threshold=%zu\n", threshold);
+#endif
+    }
+    ctx->threads = saved_threads;
+}
+
+
+#define GATHER_MIN_ELEMENTS (64UL * 1024 * 1024)
+#define GATHER_MAX_INDICES (16UL * 1024 * 1024)
+#define GATHER_MIN_TABLE (32 * 1024)
+
+
+// Gather then scatter tables of every index pattern and implementation over
+// tables from 32 KB up to the buffer size, growing 8x per row.
+static void run_gather_mode(ms_ctx_t *ctx, uint64_t *table, size_t size) {
+    for (int scatter = 0; scatter <= 1; scatter++) {
+        printf("\n%s, elements/s and effective GB/s (8 bytes per element)\n%-10s %-10s",
+            scatter ? "Scatter" : "Gather", "Table", "Impl");
+        for (ms_index_pattern_t p = 0; p < MS_INDEX_PATTERNS; p++) {
+            printf(" %25s", ms_index_pattern_name(p));
         }
         printf("\n");
+        for (size_t bytes = GATHER_MIN_TABLE; bytes <= size; bytes = bytes < size && bytes * 8 > size ?
+                size : bytes * 8) {
+            size_t elements = MIN(bytes / sizeof(uint64_t), (size_t) UINT32_MAX + 1);
+            size_t count = MIN(elements, GATHER_MAX_INDICES) / 16 * 16;
+            ms_index_t index[MS_INDEX_PATTERNS];
+            for (ms_index_pattern_t p = 0; p < MS_INDEX_PATTERNS; p++) {
+                if (ms_index_init(ctx, &index[p], p, elements, count) != 0) {
+                    fprintf(stderr, "%s\n", ms_error(ctx));
+                    exit(1);
+                }
+            }
+            for (const ms_index_impl_t *impl = ms_index_impls(); impl->name != NULL; impl++) {
+                if (scatter && impl->scatter == NULL) {
+                    continue;
+                }
+                printf("%-10s %-10s", human_size(bytes), impl->name);
+                if (elements > impl->max_elements) {
+                    printf(" %25s\n", "indices sign extended");
+                    continue;
+                }
+                for (ms_index_pattern_t p = 0; p < MS_INDEX_PATTERNS; p++) {
+                    ms_index_result_t r;
+                    if (ms_index_bench(ctx, impl, scatter, table, &index[p], GATHER_MIN_ELEMENTS, &r) != 0) {
+                        fprintf(stderr, "%s\n", ms_error(ctx));
+                        exit(1);
+                    }
+                    double rate = r.elements / r.time;
+                    printf(" %10s/s %10s/s", human_count(rate), human_size(rate * sizeof(uint64_t)));
+                    fflush(stdout);
+                }
+                printf("\n");
+            }
+            for (ms_index_pattern_t p = 0; p < MS_INDEX_PATTERNS; p++) {
+                ms_index_destroy(&index[p]);
+            }
+            if (bytes == size) {
+                break;
+            }
+        }
     }
-#endif
+}
 
-    for (size_t i = 0; i < g_thread_count; i++) {
-        thread_options_t *options = malloc(sizeof(thread_options_t));
-        if (options == NULL) {
-            fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
+
+#define SPSC_DEFAULT_BYTES (4UL * GB)
+
+
+// Stream messages through PAIRS rings with the consumer on the producer's SMT
+// sibling, another core of its L3, another package and, as a fallback that
+// needs no topology, any other CPU.
+static void run_spsc_mode(ms_ctx_t *ctx, void *mem, size_t size, const ms_spsc_t *cfg, size_t pairs) {
+    printf("\n%-8s %-24s %14s %14s %14s\n", "Place", "CPUs", "Msgs/s/pair", "Speed/pair", "Total");
+    for (ms_placement_t place = 0; place < MS_PLACEMENTS; place++) {
+        int cpus[2 * MS_SPSC_MAX_PAIRS];
+        if (ms_spsc_pairs(ctx, place, pairs, cpus) != 0) {
+            printf("%-8s unavailable: %s\n", ms_placement_name(place), ms_error(ctx));
+            continue;
+        }
+        char cpu_desc[32] = "unpinned";
+        if (cpus[0] >= 0) {
+            snprintf(cpu_desc, sizeof(cpu_desc), "%d->%d%s", cpus[0], cpus[1], pairs > 1 ? ", ..." : "");
+        }
+        ms_spsc_result_t r;
+        if (ms_spsc_bench(ctx, mem, size, cfg, pairs, cpus, &r) != 0) {
+            fprintf(stderr, "%s\n", ms_error(ctx));
             exit(1);
         }
-        size_t shard_size = buffer_size / g_thread_count;
-        options->id = i;
-        options->test = test;
-        options->mem = mem + (shard_size * i);
-        options->size = shard_size;
-        options->ready = &ready;
-        options->done = &done;
-        options->ready_cond = &ready_cond;
-        options->ready_mut = &ready_mut;
-        options->start_cond = &start_cond;
-        options->start_mut = &start_mut;
-        options->prog_cond = &prog_cond;
-        options->prog_mut = &prog_mut;
-        options->iterations = transfer_size / buffer_size;
-        ZERO_OR_EXIT(pthread_create(&threads[i], NULL, threaded_test_runner, options));
-#ifdef __linux__
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        int cpu = cpus_topo->cpus[options->id % cpus_topo->count];
-        if (g_verbose) {
-            printf("Thread %d mapped to CPU core: %d\n", options->id, cpu);
-        }
-        CPU_SET(cpu, &cpuset);
-        ZERO_OR_EXIT(pthread_setaffinity_np(threads[i], sizeof(cpuset), &cpuset));
-#endif
+        printf("%-8s %-24s %12s/s %12s/s %12s/s\n", ms_placement_name(place), cpu_desc,
+            human_count(r.pair_rate), human_size(r.pair_rate * cfg->msg_size),
+            human_size(r.messages * cfg->msg_size / r.time));
+        fflush(stdout);
     }
+}
 
-    ZERO_OR_EXIT(pthread_mutex_lock(&ready_mut));
-    while (ready < g_thread_count) {
-        ZERO_OR_EXIT(pthread_cond_wait(&ready_cond, &ready_mut));
+
+// Run STRATEGY over every layout, the block layout only when a block size was
+// given, and compare the slowest and fastest worker's own speed.
+static void run_layout_mode(ms_ctx_t *ctx, void *mem, size_t size, size_t transfer_size,
+                            const ms_strategy_t *strat) {
+    ctx->progress = NULL;
+    const size_t shard_size = size / ctx->threads;
+    printf("%-12s %10s %14s %14s %14s %8s\n", "Layout", "Block", "Speed", "Slowest", "Fastest", "Spread");
+    for (ms_layout_t layout = MS_LAYOUT_CONTIGUOUS; layout <= MS_LAYOUT_BLOCK; layout++) {
+        if (layout == MS_LAYOUT_BLOCK && ctx->block_size == 0) {
+            continue;
+        }
+        ctx->layout = layout;
+        const char *block = human_size(ms_layout_block(ctx, shard_size));
+        if (!layout_fits(ctx, strat, shard_size)) {
+            printf("%-12s %10s %14s\n", ms_layout_name(layout), block, "unsupported");
+            continue;
+        }
+        if (ms_bench_threaded(ctx, mem, size, transfer_size, strat->test) != 0) {
+            fprintf(stderr, "%s\n", ms_error(ctx));
+            exit(1);
+        }
+        double slowest = 0;
+        double fastest = 0;
+        double mean = 0;
+        for (size_t i = 0; i < ctx->threads; i++) {
+            double speed = ctx->thread_chunks[i] * shard_size / MAX(ctx->thread_times[i], 1e-9);
+            slowest = i == 0 ? speed : MIN(slowest, speed);
+            fastest = MAX(fastest, speed);
+            mean += speed / ctx->threads;
+        }
+        double speed = ctx->transferred / (ctx->end_time - ctx->start_time);
+        printf("%-12s %10s %12s/s %12s/s %12s/s %7.1f%%\n", ms_layout_name(layout), block,
+            human_size(speed), human_size(slowest), human_size(fastest), 100 * (fastest - slowest) / mean);
+        fflush(stdout);
     }
-    ZERO_OR_EXIT(pthread_mutex_unlock(&ready_mut));
+}
 
-    ZERO_OR_EXIT(pthread_mutex_lock(&start_mut));
-    ZERO_OR_EXIT(pthread_cond_broadcast(&start_cond));
-    ZERO_OR_EXIT(pthread_mutex_unlock(&start_mut));
-    g_start_time = get_time();
-    draw_state_t draw_state = {.last_time = g_start_time};
 
-    ZERO_OR_EXIT(pthread_mutex_lock(&prog_mut));
-    while (done < g_thread_count) {
-        ZERO_OR_EXIT(pthread_cond_wait(&prog_cond, &prog_mut));
-        maybe_draw_progress(&draw_state);
+// Plain and _nt baselines first, then every write back kernel.
+static const char *flush_strategies[] = {
+#ifdef __x86_64__
+    "x86asm_x8", "x86asm_nt_x8", "clflush", "clflushopt", "clwb", "cldemote",
+#endif
+#ifdef __aarch64__
+    "armasm_x8", "armasm_nt_x8", "dc_cvac", "dc_civac", "dc_cvap",
+#endif
+    NULL
+};
+
+
+static void run_flush_mode(ms_ctx_t *ctx, void *mem, size_t size, size_t transfer_size) {
+    ctx->progress = NULL;
+    printf("%-14s %14s %14s %10s\n", "Strategy", "Speed", "Per thread", "ns/line");
+    for (const char **name = flush_strategies; *name != NULL; name++) {
+        const ms_strategy_t *strat = ms_strategy_find(*name);
+        if (strat == NULL) {
+            printf("%-14s %14s\n", *name, "unsupported");
+            continue;
+        }
+        int rc = ctx->threads > 1 ?
+            ms_bench_threaded(ctx, mem, size, transfer_size, strat->test) :
+            ms_bench(ctx, mem, size, transfer_size, strat->test);
+        if (rc != 0) {
+            fprintf(stderr, "%s\n", ms_error(ctx));
+            exit(1);
+        }
+        double time = ctx->end_time - ctx->start_time;
+        double speed = ctx->transferred / time;
+        // Each thread writes its own lines, so its time per line is the
+        // wall time over its share of them.
+        double lines = (double) ctx->transferred / MS_CACHE_LINE / ctx->threads;
+        printf("%-14s %12s/s %12s/s %10.2f\n", *name, human_size(speed),
+            human_size(speed / ctx->threads), time / lines * 1e9);
+        fflush(stdout);
     }
-    ZERO_OR_EXIT(pthread_mutex_unlock(&prog_mut));
-    printf("\n");
+}
+
+
+// Passes per bandwidth probe when no --transfer is given.
+#define DAEMON_PASSES 4
+#define DAEMON_LOADS (1UL << 20)
+// The latency chain gets its own, smaller buffer so the write probe cannot
+// unlink it.
+#define DAEMON_LATENCY_SIZE (256 * MB)
 
-    for (size_t i = 0; i < g_thread_count; i++) {
-        pthread_join(threads[i], NULL);
+static const double daemon_speed_bounds[DAEMON_BUCKETS] = {
+    1e9, 2e9, 5e9, 10e9, 20e9, 50e9, 100e9, 200e9, 500e9, 1e12,
+};
+static const double daemon_latency_bounds[DAEMON_BUCKETS] = {
+    50e-9, 75e-9, 100e-9, 125e-9, 150e-9, 200e-9, 300e-9, 500e-9, 1e-6, 2e-6,
+};
+
+static volatile sig_atomic_t g_daemon_stop = 0;
+
+
+static void on_daemon_signal(int _) {
+    (void) _;
+    g_daemon_stop = 1;
+}
+
+
+static void histogram_observe(histogram_t *h, double value) {
+    for (size_t i = 0; i < DAEMON_BUCKETS; i++) {
+        if (value <= h->bounds[i]) {
+            h->counts[i]++;
+        }
     }
+    h->count++;
+    h->sum += value;
 }
 
 
-static void bench(void *mem, size_t buffer_size, size_t transfer_size, mem_write_test test) {
-    if (buffer_size < 1 || transfer_size < buffer_size) {
-        fprintf(stderr, "Invalid bench args\n");
-        exit(1);
+static size_t print_histogram(char *buf, size_t size, const char *name, const char *help,
+                              const char *labels, const histogram_t *h) {
+    size_t n = snprintf(buf, size, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (size_t i = 0; i < DAEMON_BUCKETS && n < size; i++) {
+        n += snprintf(buf + n, size - n, "%s_bucket{%s,le=\"%g\"} %zu\n", name, labels,
+            h->bounds[i], h->counts[i]);
     }
-    g_start_time = get_time();
-    draw_state_t draw_state = {.last_time = g_start_time};
-    for (size_t iter = 1; iter <= transfer_size / buffer_size; iter++) {
-        test(mem, buffer_size, iter);
-        g_transferred += buffer_size;
-        maybe_draw_progress(&draw_state);
+    if (n < size) {
+        n += snprintf(buf + n, size - n, "%s_bucket{%s,le=\"+Inf\"} %zu\n%s_sum{%s} %.9g\n"
+            "%s_count{%s} %zu\n", name, labels, h->count, name, labels, h->sum, name, labels, h->count);
     }
-    printf("\n");
+    return MIN(n, size);
 }
 
 
-static void print_results(double time) {
-    printf("Transferred: %s\n", human_size(g_transferred));
-    printf("Time: %.3f s\n", time);
-    printf("Speed: %s/s\n", human_size(g_transferred / time));
+static size_t print_gauge(char *buf, size_t size, const char *name, const char *help,
+                          const char *labels, double value) {
+    size_t n = snprintf(buf, size, "# HELP %s %s\n# TYPE %s gauge\n%s{%s} %.9g\n", name, help,
+        name, name, labels, value);
+    return MIN(n, size);
 }
 
 
-static void on_interrupted(int _) {
-    (void) _;
-    double end_time = get_time();
-    printf("\n\nINTERRUPTED\n\n");
-    print_results(end_time - g_start_time);
-    exit(1);
+static void render_metrics(daemon_state_t *d, ms_ctx_t *ctx, size_t buffer_size) {
+    char labels[256];
+    snprintf(labels, sizeof(labels), "strategy=\"%s\",threads=\"%zu\",buffer_bytes=\"%zu\"",
+        d->strategy, ctx->threads, buffer_size);
+    char *buf = d->text;
+    size_t size = sizeof(d->text);
+    size_t n = 0;
+    n += print_gauge(buf + n, size - n, "memspeed_write_last_bytes_per_second",
+        "Write bandwidth of the latest probe", labels, d->last_speed);
+    n += print_histogram(buf + n, size - n, "memspeed_write_bytes_per_second",
+        "Write bandwidth of every probe", labels, &d->speed);
+    n += print_gauge(buf + n, size - n, "memspeed_load_latency_last_seconds",
+        "Dependent load latency of the latest probe", labels, d->last_latency);
+    n += print_histogram(buf + n, size - n, "memspeed_load_latency_seconds",
+        "Dependent load latency of every probe", labels, &d->latency);
+    n += print_gauge(buf + n, size - n, "memspeed_probe_duration_seconds",
+        "Wall time of the latest probe", labels, d->last_runtime);
+    n += print_gauge(buf + n, size - n, "memspeed_last_probe_timestamp_seconds",
+        "Unix time the latest probe finished", labels, d->last_probe);
+    if (n < size) {
+        snprintf(buf + n, size - n, "# HELP memspeed_probes_total Probes run\n"
+            "# TYPE memspeed_probes_total counter\nmemspeed_probes_total{%s} %zu\n", labels, d->probes);
+    }
+}
+
+
+// Replace the textfile atomically so node_exporter never reads half of it.
+static void publish_textfile(daemon_state_t *d) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", d->textfile, (int) getpid());
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to write %s: %s\n", tmp, strerror(errno));
+        return;
+    }
+    bool ok = fputs(d->text, f) >= 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, d->textfile) != 0) {
+        fprintf(stderr, "Failed to publish %s: %s\n", d->textfile, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+
+static void open_daemon_socket(daemon_state_t *d) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(d->socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", d->socket_path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, d->socket_path);
+    d->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (d->listen_fd < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        exit(1);
+    }
+    unlink(d->socket_path);
+    if (bind(d->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(d->listen_fd, 16) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", d->socket_path, strerror(errno));
+        exit(1);
+    }
+}
+
+
+// Serve the latest metrics to every client that connects until deadline.
+static void serve_until(daemon_state_t *d, double deadline) {
+    double now;
+    while (!g_daemon_stop && (now = ms_time()) < deadline) {
+        if (d->listen_fd < 0) {
+            double wait = MIN(deadline - now, 1.0);
+            struct timespec ts = {.tv_sec = (time_t) wait, .tv_nsec = (wait - (time_t) wait) * 1e9};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+        struct pollfd pfd = {.fd = d->listen_fd, .events = POLLIN};
+        int timeout_ms = MIN((deadline - now) * 1000 + 1, 1000);
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            continue;
+        }
+        int fd = accept4(d->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        size_t len = strlen(d->text);
+        for (size_t off = 0; off < len;) {
+            ssize_t wrote = send(fd, d->text + off, len - off, MSG_NOSIGNAL);
+            if (wrote <= 0) {
+                break;
+            }
+            off += wrote;
+        }
+        close(fd);
+    }
+}
+
+
+// Probe write bandwidth and load latency every interval, spaced further apart
+// when needed so probes use at most budget percent of one CPU.  Both buffers
+// are allocated once and reused by every probe.
+static void run_daemon_mode(ms_ctx_t *ctx, daemon_state_t *d, void *mem, size_t buffer_size,
+                            size_t transfer_size, const ms_strategy_t *strat, ms_mlp_t *mlp) {
+    ctx->progress = NULL;
+    d->listen_fd = -1;
+    if (d->socket_path != NULL) {
+        open_daemon_socket(d);
+    }
+    d->speed.bounds = daemon_speed_bounds;
+    d->latency.bounds = daemon_latency_bounds;
+    signal(SIGINT, on_daemon_signal);
+    signal(SIGTERM, on_daemon_signal);
+    while (!g_daemon_stop) {
+        double start = ms_time();
+        int rc = ctx->threads > 1 ?
+            ms_bench_threaded(ctx, mem, buffer_size, transfer_size, strat->test) :
+            ms_bench(ctx, mem, buffer_size, transfer_size, strat->test);
+        double bench_time = ctx->end_time - ctx->start_time;
+        d->last_speed = ctx->transferred / bench_time;
+        ms_mlp_result_t r;
+        if (rc != 0 || ms_mlp_run(ctx, mlp, 1, DAEMON_LOADS, &r) != 0) {
+            fprintf(stderr, "%s\n", ms_error(ctx));
+            exit(1);
+        }
+        double end = ms_time();
+        d->probes++;
+        d->last_latency = r.latency;
+        d->last_runtime = end - start;
+        d->last_probe = (double) time(NULL);
+        histogram_observe(&d->speed, d->last_speed);
+        histogram_observe(&d->latency, d->last_latency);
+        render_metrics(d, ctx, buffer_size);
+        if (d->textfile != NULL) {
+            publish_textfile(d);
+        }
+        // The bandwidth probe keeps every worker busy, so charge it per thread.
+        double busy = bench_time * ctx->threads + (d->last_runtime - bench_time);
+        double period = MAX(d->interval, busy * 100 / d->budget);
+        serve_until(d, start + period);
+    }
+    if (d->listen_fd >= 0) {
+        close(d->listen_fd);
+        unlink(d->socket_path);
+    }
+}
+
+
+static const char *suite_keys[SUITE_KEYS] = {
+    "strategy", "size", "threads", "source", "pages", "sched", "transfer",
+};
+
+
+static void suite_add(suite_t *suite, char *values[SUITE_KEYS], size_t default_transfer,
+                      const char *path, int line_no) {
+    if (suite->count == suite->capacity) {
+        suite->capacity = suite->capacity ? suite->capacity * 2 : 64;
+        suite->runs = realloc(suite->runs, suite->capacity * sizeof(suite_run_t));
+        if (suite->runs == NULL) {
+            fprintf(stderr, "Mem alloc failed %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    suite_run_t *run = &suite->runs[suite->count++];
+    memset(run, 0, sizeof(*run));
+    snprintf(run->strategy, sizeof(run->strategy), "%s", values[0]);
+    char size[64];
+    snprintf(size, sizeof(size), "%s", values[1]);
+    run->buffer_size = str_to_buffer_size(size);
+    run->threads = str_to_pos_u64(values[2]);
+    snprintf(run->source, sizeof(run->source), "%s", values[3]);
+    snprintf(run->pages, sizeof(run->pages), "%s", values[4]);
+    snprintf(run->sched, sizeof(run->sched), "%s", values[5]);
+    run->transfer_size = values[6] != NULL ? str_to_pos_u64(values[6]) * GB : default_transfer;
+    ms_source_t source;
+    ms_pages_t pages;
+    ms_sched_t sched;
+    if (ms_strategy_find(run->strategy) == NULL || run->threads < 1 || run->threads > 1000 ||
+        run->buffer_size < 1 || ms_pages_parse(run->pages, &pages) != 0 ||
+        ms_sched_parse(run->sched, &sched) != 0 ||
+        (strncmp(run->source, "file:", 5) != 0 &&
+         (ms_source_parse(run->source, &source) != 0 || source == MS_SOURCE_FILE))) {
+        fprintf(stderr, "%s:%d: Invalid run: strategy=%s size=%s threads=%s source=%s pages=%s sched=%s\n",
+            path, line_no, values[0], values[1], values[2], values[3], values[4], values[5]);
+        exit(1);
+    }
+}
+
+
+// Suite runs take every setting from the suite file, so refuse any option
+// they would ignore rather than run without it.
+static void check_suite_args(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--suite") == 0 || strncmp(argv[i], "--trans", 7) == 0 ||
+            strcmp(argv[i], "--batch") == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--verbose") != 0) {
+            fprintf(stderr, "%s does not apply to --suite, only --transfer, --batch and --verbose do\n",
+                argv[i]);
+            exit(1);
+        }
+    }
+}
+
+
+// Each line is one grid of space separated KEY=VALUE[,VALUE...] settings,
+// expanded to every combination.  Unset keys take the defaults below.
+static void load_suite(const char *path, size_t default_transfer, suite_t *suite) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open suite %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    memset(suite, 0, sizeof(*suite));
+    char line[4096];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_no++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *grid[SUITE_KEYS][SUITE_MAX_VALUES];
+        size_t counts[SUITE_KEYS] = {0};
+        char *save;
+        bool empty = true;
+        for (char *tok = strtok_r(line, " \t", &save); tok != NULL; tok = strtok_r(NULL, " \t", &save)) {
+            empty = false;
+            char *val = strchr(tok, '=');
+            size_t k = 0;
+            if (val != NULL) {
+                *val++ = '\0';
+                while (k < SUITE_KEYS && strcmp(suite_keys[k], tok) != 0) {
+                    k++;
+                }
+            }
+            if (val == NULL || k == SUITE_KEYS || counts[k] > 0) {
+                fprintf(stderr, "%s:%d: Expected one of strategy, size, threads, source, pages, "
+                    "sched or transfer=VALUE[,VALUE...], got %s\n", path, line_no, tok);
+                exit(1);
+            }
+            char *vsave;
+            for (char *v = strtok_r(val, ",", &vsave); v != NULL && counts[k] < SUITE_MAX_VALUES;
+                    v = strtok_r(NULL, ",", &vsave)) {
+                grid[k][counts[k]++] = v;
+            }
+        }
+        if (empty) {
+            continue;
+        }
+        static char *defaults[SUITE_KEYS] = {"c", "4096", "1", "malloc", "base", "static", NULL};
+        for (size_t k = 0; k < SUITE_KEYS; k++) {
+            if (counts[k] == 0) {
+                grid[k][counts[k]++] = defaults[k];
+            }
+        }
+        // Odometer over the grid, last key fastest.
+        size_t idx[SUITE_KEYS] = {0};
+        for (;;) {
+            char *values[SUITE_KEYS];
+            for (size_t k = 0; k < SUITE_KEYS; k++) {
+                values[k] = grid[k][idx[k]];
+            }
+            suite_add(suite, values, default_transfer, path, line_no);
+            size_t k = SUITE_KEYS;
+            while (k > 0 && ++idx[k - 1] == counts[k - 1]) {
+                idx[--k] = 0;
+            }
+            if (k == 0) {
+                break;
+            }
+        }
+    }
+    fclose(f);
+    if (suite->count == 0) {
+        fprintf(stderr, "%s: No runs\n", path);
+        exit(1);
+    }
+}
+
+
+// Run every suite entry on one allocation per source and page type, sized for
+// the largest run and sliced for the smaller ones, then print all results.
+static void run_suite_mode(ms_ctx_t *ctx, suite_t *suite) {
+    ctx->progress = NULL;
+    for (size_t g = 0; g < suite->count; g++) {
+        suite_run_t *lead = &suite->runs[g];
+        if (lead->done) {
+            continue;
+        }
+        ms_buffer_t buf = {0};
+        parse_source(lead->source, &buf);
+        ms_pages_parse(lead->pages, &buf.pages);
+        for (size_t i = g; i < suite->count; i++) {
+            suite_run_t *run = &suite->runs[i];
+            size_t div = ctx->page_size * run->threads;
+            run->buffer_size = MAX(run->buffer_size / div, 1) * div;
+            run->transfer_size = MAX(run->transfer_size / run->buffer_size, 1) * run->buffer_size;
+            if (strcmp(run->source, lead->source) == 0 && strcmp(run->pages, lead->pages) == 0) {
+                buf.size = MAX(buf.size, run->buffer_size);
+            }
+        }
+        printf("Allocating memory [%s, %s]: %s\n", lead->source, lead->pages, human_size(buf.size));
+        if (ms_alloc(ctx, &buf) != 0) {
+            fprintf(stderr, "%s\n", ms_error(ctx));
+            exit(1);
+        }
+        ms_prefault(buf.mem, buf.size);
+        for (size_t i = g; i < suite->count; i++) {
+            suite_run_t *run = &suite->runs[i];
+            if (strcmp(run->source, lead->source) != 0 || strcmp(run->pages, lead->pages) != 0) {
+                continue;
+            }
+            printf("Run %zu/%zu: %s, %s, %zu threads\n", i + 1, suite->count, run->strategy,
+                human_size(run->buffer_size), run->threads);
+            fflush(stdout);
+            ctx->threads = run->threads;
+            ms_sched_parse(run->sched, &ctx->sched);
+            const ms_strategy_t *strat = ms_strategy_find(run->strategy);
+            int rc = ctx->threads > 1 ?
+                ms_bench_threaded(ctx, buf.mem, run->buffer_size, run->transfer_size, strat->test) :
+                ms_bench(ctx, buf.mem, run->buffer_size, run->transfer_size, strat->test);
+            if (rc != 0) {
+                fprintf(stderr, "%s\n", ms_error(ctx));
+                exit(1);
+            }
+            run->transferred = ctx->transferred;
+            run->time = ctx->end_time - ctx->start_time;
+            run->done = true;
+        }
+        ms_dealloc(&buf);
+    }
+    printf("\n%-14s %10s %7s %-16s %-8s %-8s %12s %9s %12s\n", "Strategy", "Size", "Threads",
+        "Source", "Pages", "Sched", "Transferred", "Time", "Speed");
+    for (size_t i = 0; i < suite->count; i++) {
+        suite_run_t *run = &suite->runs[i];
+        printf("%-14s %10s %7zu %-16s %-8s %-8s", run->strategy, human_size(run->buffer_size),
+            run->threads, run->source, run->pages, run->sched);
+        printf(" %12s %7.3f s", human_size(run->transferred), run->time);
+        printf(" %10s/s\n", human_size(run->transferred / run->time));
+    }
+}
+
+
+static void print_results(size_t transferred, double time) {
+    printf("Transferred: %s\n", human_size(transferred));
+    printf("Time: %.3f s\n", time);
+    printf("Speed: %s/s\n", human_size(transferred / time));
+}
+
+
+static void print_energy_line(const char *name, double joules, size_t transferred, double time) {
+    if (joules < 0) {
+        printf("Energy [%s]: unreadable\n", name);
+        return;
+    }
+    printf("Energy [%s]: %.2f J, %.1f W avg", name, joules, joules / time);
+    if (joules > 0) {
+        printf(", %.3f nJ/B, %.3f GB/s per W", joules * 1e9 / transferred, (double) transferred / GB / joules);
+    }
+    printf("\n");
+}
+
+
+static void print_energy(ms_ctx_t *ctx) {
+    double time = ctx->end_time - ctx->start_time;
+    double total = 0;
+    for (size_t i = 0; i < ctx->energy->count; i++) {
+        const ms_energy_domain_t *d = &ctx->energy->domains[i];
+        print_energy_line(d->name, d->joules, ctx->transferred, time);
+        total = total < 0 || d->joules < 0 ? -1 : total + d->joules;
+    }
+    if (ctx->energy->count > 1) {
+        print_energy_line("total", total, ctx->transferred, time);
+    }
+}
+
+
+static void print_ticks(ms_ctx_t *ctx) {
+    uint64_t ticks = ctx->end_ticks - ctx->start_ticks;
+    if (ticks == 0) {
+        printf("Cycle counter unavailable\n");
+        return;
+    }
+#ifdef __x86_64__
+    const char *counter = "TSC";
+#else
+    const char *counter = "CNTVCT";
+#endif
+    printf("Counter: %s at %.1f MHz\n", counter, ticks / (ctx->end_time - ctx->start_time) / 1e6);
+    printf("Bytes/tick: %.2f\n", (double) ctx->transferred / ticks);
+}
+
+
+// Per worker share of the run and speed over its own time, then totals per
+// core type when there are several.  unit is the chunk, or shard pass, size.
+static void print_threads(ms_ctx_t *ctx, size_t unit, const char *unit_name) {
+    double time = ctx->end_time - ctx->start_time;
+    char types[ctx->threads][16];
+    printf("\n%-8s %6s %-8s %12s %8s %12s\n", "Thread", "CPU", "Type", unit_name, "Share", "Speed");
+    for (size_t i = 0; i < ctx->threads; i++) {
+        size_t chunks = ctx->thread_chunks[i];
+        read_cpu_type(ctx->thread_cpus[i], types[i], sizeof(types[i]));
+        printf("%-8zu %6d %-8s %12zu %7.1f%% %10s/s\n", i, ctx->thread_cpus[i], types[i], chunks,
+            100.0 * chunks * unit / MAX(ctx->transferred, 1),
+            human_size(chunks * unit / MAX(ctx->thread_times[i], 1e-9)));
+    }
+    size_t type_count = 0;
+    for (size_t i = 0; i < ctx->threads; i++) {
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = strcmp(types[i], types[j]) == 0;
+        }
+        type_count += !seen;
+    }
+    if (type_count < 2) {
+        return;
+    }
+    printf("\n%-8s %6s %12s %12s %12s\n", "Type", "Threads", unit_name, "Speed", "Per thread");
+    for (size_t i = 0; i < ctx->threads; i++) {
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = strcmp(types[i], types[j]) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+        size_t threads = 0;
+        size_t chunks = 0;
+        for (size_t j = i; j < ctx->threads; j++) {
+            if (strcmp(types[i], types[j]) == 0) {
+                threads++;
+                chunks += ctx->thread_chunks[j];
+            }
+        }
+        double speed = chunks * unit / time;
+        printf("%-8s %6zu %12zu %10s/s", types[i], threads, chunks, human_size(speed));
+        printf(" %10s/s\n", human_size(speed / threads));
+    }
+}
+
+
+static void on_interrupted(int _) {
+    (void) _;
+    double end_time = ms_time();
+    printf("\n\nINTERRUPTED\n\n");
+    print_results(g_ctx->transferred, end_time - g_ctx->start_time);
+    if (g_soak) {
+        printf("\n");
+        print_soak_summary(g_soak);
+    }
+    exit(1);
 }
 
 
 int main(int argc, char *argv[]) {
-    g_page_size = sysconf(_SC_PAGESIZE);
-    size_t buffer_size_mb = 4 * 1024;
+    ms_ctx_t ctx;
+    if (ms_ctx_init(&ctx) != 0) {
+        fprintf(stderr, "%s\n", ms_error(&ctx));
+        exit(1);
+    }
+    g_ctx = &ctx;
+    size_t buffer_size = 4 * GB;
     size_t transfer_size_gb = 100;
     char *strategy = "c";
-    int use_mmap = 0;
+    char *source = NULL;
+    bool map_sync = false;
+    bool report_sync = false;
+    bool fault_mode = false;
+    size_t mlp_chains = 0;
+    size_t crossover_threads = 0;
+    bool copy_mode = false;
+    size_t align_step = 0;
+    bool flush_mode = false;
+    bool gather_mode = false;
+    size_t spsc_pairs = 0;
+    ms_spsc_t spsc = {.ring_size = 64 * 1024, .msg_size = 64, .batch = 16};
+    bool transfer_set = false;
+    char *suite_path = NULL;
+    daemon_state_t daemon = {.budget = 1};
+    bool report_ticks = false;
+    bool report_energy = false;
+    char *sched = "static";
+    size_t chunk_kb = 0;
+    char *layout = "contiguous";
+    size_t block_bytes = 0;
+    char *pages = "base";
+    double duration = 0;
+    double interval = 10;
+    char *save_path = NULL;
+    char *compare_path = NULL;
+    double threshold = 5;
+    double extreme_threshold = 0;
     for (int i = 1; i < argc; i++) {
         if (strncmp(argv[i], "--strat", 7) == 0) {
             if (argc < i + 2) {
@@ -923,171 +1831,710 @@ int main(int argc, char *argv[]) {
                 exit(1);
             }
             transfer_size_gb = str_to_pos_u64(argv[++i]);
+            transfer_set = true;
         } else if (strncmp(argv[i], "--threads", 9) == 0) {
             if (argc < i + 2) {
                 fprintf(stderr, "Expected THREAD_COUNT argument\n");
                 exit(1);
             }
-            g_thread_count = str_to_pos_u64(argv[++i]);
-            if (g_thread_count < 1 || g_thread_count > 1000) {
-                fprintf(stderr, "Invalid THREAD_COUNT: %ld\n", g_thread_count);
+            ctx.threads = str_to_pos_u64(argv[++i]);
+            if (ctx.threads < 1 || ctx.threads > 1000) {
+                fprintf(stderr, "Invalid THREAD_COUNT: %ld\n", ctx.threads);
+                exit(1);
+            }
+        } else if (strncmp(argv[i], "--dur", 5) == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected DURATION argument\n");
+                exit(1);
+            }
+            duration = str_to_duration(argv[++i]);
+        } else if (strcmp(argv[i], "--interval") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected INTERVAL_SECS argument\n");
+                exit(1);
+            }
+            interval = str_to_duration(argv[++i]);
+        } else if (strcmp(argv[i], "--save-baseline") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected BASELINE_FILE argument\n");
+                exit(1);
+            }
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected BASELINE_FILE argument\n");
+                exit(1);
+            }
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected THRESHOLD_PCT argument\n");
                 exit(1);
             }
+            threshold = str_to_pos_double(argv[++i]);
+        } else if (strcmp(argv[i], "--extreme-threshold") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected EXTREME_PCT argument\n");
+                exit(1);
+            }
+            extreme_threshold = str_to_pos_double(argv[++i]);
+        } else if (strcmp(argv[i], "--source") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected SOURCE argument\n");
+                exit(1);
+            }
+            source = argv[++i];
         } else if (strcmp(argv[i], "--mmap") == 0) {
-            use_mmap = 1;
+            source = "shared";
+        } else if (strcmp(argv[i], "--pages") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected PAGES argument\n");
+                exit(1);
+            }
+            pages = argv[++i];
+        } else if (strcmp(argv[i], "--mlp") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected MAX_CHAINS argument\n");
+                exit(1);
+            }
+            mlp_chains = str_to_pos_u64(argv[++i]);
+            if (mlp_chains < 1 || mlp_chains > MS_MLP_MAX_CHAINS) {
+                fprintf(stderr, "Invalid MAX_CHAINS: %zu (1 - %d)\n", mlp_chains, MS_MLP_MAX_CHAINS);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--crossover") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected MAX_THREADS argument\n");
+                exit(1);
+            }
+            crossover_threads = str_to_pos_u64(argv[++i]);
+            if (crossover_threads < 1 || crossover_threads > 1000) {
+                fprintf(stderr, "Invalid MAX_THREADS: %zu\n", crossover_threads);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected INTERVAL argument\n");
+                exit(1);
+            }
+            daemon.interval = str_to_duration(argv[++i]);
+        } else if (strcmp(argv[i], "--textfile") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected TEXTFILE argument\n");
+                exit(1);
+            }
+            daemon.textfile = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected SOCKET argument\n");
+                exit(1);
+            }
+            daemon.socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected BUDGET_PCT argument\n");
+                exit(1);
+            }
+            daemon.budget = str_to_pos_double(argv[++i]);
+            if (daemon.budget <= 0 || daemon.budget > 100) {
+                fprintf(stderr, "Invalid BUDGET_PCT: %g\n", daemon.budget);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--suite") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected SUITE_FILE argument\n");
+                exit(1);
+            }
+            suite_path = argv[++i];
+        } else if (strcmp(argv[i], "--gather") == 0) {
+            gather_mode = true;
+        } else if (strcmp(argv[i], "--spsc") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected PAIRS argument\n");
+                exit(1);
+            }
+            spsc_pairs = str_to_pos_u64(argv[++i]);
+            if (spsc_pairs < 1 || spsc_pairs > MS_SPSC_MAX_PAIRS) {
+                fprintf(stderr, "Invalid PAIRS: %zu\n", spsc_pairs);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--ring") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected RING_KB argument\n");
+                exit(1);
+            }
+            spsc.ring_size = str_to_pos_u64(argv[++i]) * 1024;
+        } else if (strcmp(argv[i], "--msg") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected MSG_BYTES argument\n");
+                exit(1);
+            }
+            spsc.msg_size = str_to_pos_u64(argv[++i]);
+        } else if (strcmp(argv[i], "--spsc-batch") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected MSG_BATCH argument\n");
+                exit(1);
+            }
+            spsc.batch = str_to_pos_u64(argv[++i]);
+        } else if (strcmp(argv[i], "--flush") == 0) {
+            flush_mode = true;
+        } else if (strcmp(argv[i], "--copy") == 0) {
+            copy_mode = true;
+        } else if (strcmp(argv[i], "--align") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected STEP argument\n");
+                exit(1);
+            }
+            align_step = str_to_pos_u64(argv[++i]);
+            if (align_step < 1 || align_step >= MS_CACHE_LINE) {
+                fprintf(stderr, "Invalid STEP: %zu\n", align_step);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--offset") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected OFFSET argument\n");
+                exit(1);
+            }
+            char *end = NULL;
+            ctx.offset = strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || ctx.offset >= MS_CACHE_LINE) {
+                fprintf(stderr, "Invalid OFFSET: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected PASSES argument\n");
+                exit(1);
+            }
+            ctx.batch = str_to_pos_u64(argv[++i]);
+        } else if (strcmp(argv[i], "--cycles") == 0) {
+            report_ticks = true;
+        } else if (strcmp(argv[i], "--energy") == 0) {
+            report_energy = true;
+        } else if (strcmp(argv[i], "--sched") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected SCHED argument\n");
+                exit(1);
+            }
+            sched = argv[++i];
+        } else if (strcmp(argv[i], "--chunk") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected CHUNK_KB argument\n");
+                exit(1);
+            }
+            chunk_kb = str_to_pos_u64(argv[++i]);
+        } else if (strcmp(argv[i], "--layout") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected LAYOUT argument\n");
+                exit(1);
+            }
+            layout = argv[++i];
+        } else if (strcmp(argv[i], "--block") == 0) {
+            if (argc < i + 2) {
+                fprintf(stderr, "Expected BLOCK_BYTES argument\n");
+                exit(1);
+            }
+            block_bytes = str_to_pos_u64(argv[++i]);
+        } else if (strcmp(argv[i], "--faults") == 0) {
+            fault_mode = true;
+        } else if (strcmp(argv[i], "--map-sync") == 0) {
+            map_sync = true;
+        } else if (strcmp(argv[i], "--sync") == 0) {
+            report_sync = true;
         } else if (strcmp(argv[i], "--verbose") == 0) {
-            g_verbose = true;
+            ctx.log = stdout;
         } else if (strcmp(argv[i], "--help") == 0) {
             char pad[128] = {0};
             memset(pad, 0, sizeof(pad));
             memset(pad, ' ', MIN(sizeof(pad) - 1, strlen(argv[0])));
             fprintf(stderr, "Usage: %s [--strat[egy] STRATEGY]\n", argv[0]);
+            fprintf(stderr, "       %s [--source SOURCE [--map-sync] [--sync]]\n", pad);
             fprintf(stderr, "       %s [--mmap]\n", pad);
+            fprintf(stderr, "       %s [--pages PAGES]\n", pad);
+            fprintf(stderr, "       %s [--faults]\n", pad);
+            fprintf(stderr, "       %s [--mlp MAX_CHAINS]\n", pad);
+            fprintf(stderr, "       %s [--copy]\n", pad);
+            fprintf(stderr, "       %s [--align STEP]\n", pad);
+            fprintf(stderr, "       %s [--flush]\n", pad);
+            fprintf(stderr, "       %s [--gather]\n", pad);
+            fprintf(stderr, "       %s [--spsc PAIRS [--ring RING_KB] [--msg MSG_BYTES] [--spsc-batch MSG_BATCH]]\n", pad);
+            fprintf(stderr, "       %s [--crossover MAX_THREADS]\n", pad);
+            fprintf(stderr, "       %s [--batch PASSES] [--cycles] [--energy]\n", pad);
+            fprintf(stderr, "       %s [--daemon INTERVAL (--textfile TEXTFILE | --socket SOCKET)\n", pad);
+            fprintf(stderr, "       %s  [--budget BUDGET_PCT]]\n", pad);
+            fprintf(stderr, "       %s [--suite SUITE_FILE]\n", pad);
+            fprintf(stderr, "       %s [--offset OFFSET]\n", pad);
             fprintf(stderr, "       %s [--verbose]\n", pad);
             fprintf(stderr, "       %s [--trans[fer] TRANSFER_SIZE_GB]\n", pad);
-            fprintf(stderr, "       %s [--threads THREAD_COUNT]\n", pad);
-            fprintf(stderr, "       %s BUFFER_SIZE_MB\n", pad);
+            fprintf(stderr, "       %s [--threads THREAD_COUNT [--sched SCHED [--chunk CHUNK_KB]]\n", pad);
+            fprintf(stderr, "       %s  [--layout LAYOUT [--block BLOCK_BYTES]]]\n", pad);
+            fprintf(stderr, "       %s [--dur[ation] DURATION [--interval INTERVAL_SECS]]\n", pad);
+            fprintf(stderr, "       %s [--save-baseline BASELINE_FILE]\n", pad);
+            fprintf(stderr, "       %s [--compare BASELINE_FILE [--threshold THRESHOLD_PCT]\n", pad);
+            fprintf(stderr, "       %s  [--extreme-threshold EXTREME_PCT]]\n", pad);
+            fprintf(stderr, "       %s BUFFER_SIZE_MB[K]\n", pad);
             fprintf(stderr, "\n");
             fprintf(stderr, "    STRATEGY:\n");
-            fprintf(stderr, "        c               : A C loop subject to compiler optimizations\n");
-            fprintf(stderr, "        c_x8            : A C loop with 8 x 64bit writes\n");
-            fprintf(stderr, "        c_x32           : A C loop with 32 x 64bit writes\n");
-            fprintf(stderr, "        c_x128          : A C loop with 128 x 64bit writes\n");
-            fprintf(stderr, "        memset          : Byte by byte memset() in a loop\n");
-            fprintf(stderr, "        memcpy          : Aligned page memcpy in a loop\n");
-#ifdef __x86_64__
-            fprintf(stderr, "        x86asm          : 64bit x86 ASM\n");
-            fprintf(stderr, "        x86asm_nt       : 64bit x86 ASM (non-temporal)\n");
-            fprintf(stderr, "        x86asm_x8       : 8 x 64bit x86 ASM\n");
-            fprintf(stderr, "        x86asm_nt_x8    : 8 x 64bit x86 ASM (non-temporal)\n");
-            fprintf(stderr, "        x86asm_x32      : 32 x 64bit x86 ASM\n");
-            fprintf(stderr, "        x86asm_nt_x32   : 32 x 64bit x86 ASM (non-temporal)\n");
-#endif
-#ifdef __AVX2__
-            fprintf(stderr, "        avx2            : 256bit AVX2 intrinsics\n");
-            fprintf(stderr, "        avx2_nt         : 256bit AVX2 intrinsics (non-temporal)\n");
-# ifdef __AVX512F__
-            fprintf(stderr, "        avx512          : 512bit AVX512 intrinsics\n");
-            fprintf(stderr, "        avx512_nt       : 512bit AVX512 intrinsics (non-temporal)\n");
-# endif
-#endif
-#ifdef __aarch64__
-            fprintf(stderr, "        armasm          : 128bit ARM ASM (STP)\n");
-            fprintf(stderr, "        armasm_nt       : 128bit ARM ASM (non-temporal, STNP)\n");
-            fprintf(stderr, "        armasm_x8       : 8 x 128bit ARM ASM (STP)\n");
-            fprintf(stderr, "        armasm_nt_x8    : 8 x 128bit ARM ASM (non-temporal, SSTP)\n");
-# ifdef __ARM_NEON
-            fprintf(stderr, "        armneon         : 128bit ARM NEON SIMD intrinsics\n");
-# endif
+            for (const ms_strategy_t *s = ms_strategies(); s->name != NULL; s++) {
+                fprintf(stderr, "        %-16s: %s\n", s->name, s->desc);
+            }
+            fprintf(stderr, "\n");
+            fprintf(stderr, "    SOURCE: Buffer backing memory (default malloc, private with --faults)\n");
+            fprintf(stderr, "        malloc          : aligned_alloc() heap\n");
+            fprintf(stderr, "        private         : Anonymous MAP_PRIVATE mmap\n");
+            fprintf(stderr, "        shared          : Anonymous MAP_SHARED mmap, same as --mmap\n");
+#ifdef __linux__
+            fprintf(stderr, "        memfd           : MAP_SHARED memfd_create() segment\n");
 #endif
+            fprintf(stderr, "        file:PATH       : MAP_SHARED file, or an unlinked temp file in a PATH directory\n");
+            fprintf(stderr, "                          (tmpfs, hugetlbfs, ...); --map-sync adds MAP_SYNC for DAX\n");
+            fprintf(stderr, "    --sync: Report msync() and fdatasync() cost of the dirty buffer after the run\n");
+            fprintf(stderr, "\n");
+            fprintf(stderr, "    PAGES: base (default), thp (MADV_HUGEPAGE) or hugetlb (reserved huge pages)\n");
+            fprintf(stderr, "    --faults: Time page faults and mapping churn instead of writes.  Each thread maps\n");
+            fprintf(stderr, "              BUFFER_SIZE_MB / THREAD_COUNT, TRANSFER_SIZE_GB / BUFFER_SIZE_MB times\n");
+            fprintf(stderr, "    --mlp: Walk 1..MAX_CHAINS independent random pointer chains through the buffer\n");
+            fprintf(stderr, "           together to find how many misses one core keeps in flight\n");
+            fprintf(stderr, "    --copy: Compare copy implementations from 16 B to half the buffer at several\n");
+            fprintf(stderr, "            src/dst alignments; ns per copy up to 64 KB, speed above\n");
+            fprintf(stderr, "    --align: Stream unaligned loads and stores of every vector width from buffer offsets\n");
+            fprintf(stderr, "             0, STEP, 2 x STEP .. 63, then time one access per page placed aligned,\n");
+            fprintf(stderr, "             across a cache line and across the page boundary\n");
+            fprintf(stderr, "    ALIGN_IMPL:\n");
+            for (const ms_align_impl_t *a = ms_align_impls(); a->name != NULL; a++) {
+                fprintf(stderr, "        %-16s: %s\n", a->name, a->desc);
+            }
+            fprintf(stderr, "    --flush: Compare the cache line write back strategies with plain and _nt stores;\n");
+            fprintf(stderr, "             speed and ns per line per thread\n");
+            fprintf(stderr, "    --gather: Gather and scatter 64bit elements through sequential, clustered (whole\n");
+            fprintf(stderr, "              lines, random order) and random indices, tables of 32 KB up to the buffer\n");
+            fprintf(stderr, "    INDEX_IMPL:\n");
+            for (const ms_index_impl_t *x = ms_index_impls(); x->name != NULL; x++) {
+                fprintf(stderr, "        %-16s: %s\n", x->name, x->desc);
+            }
+            fprintf(stderr, "    PAIRS: Producer/consumer thread pairs streaming messages through lock-free rings in\n");
+            fprintf(stderr, "           the buffer, consumers on SMT siblings, the same L3, another socket or any CPU.\n");
+            fprintf(stderr, "           Each pair sends TRANSFER_SIZE_GB (default %s) of messages\n",
+                human_size(SPSC_DEFAULT_BYTES));
+            fprintf(stderr, "    RING_KB: Message slots per ring (default 64)\n");
+            fprintf(stderr, "    MSG_BYTES: Message size, a multiple of 8 (default 64)\n");
+            fprintf(stderr, "    MSG_BATCH: Messages written or read per head/tail update (default 16)\n");
+            fprintf(stderr, "    --crossover: For 1, 2, 4 .. MAX_THREADS threads, find the shard size from which each\n");
+            fprintf(stderr, "                 _nt strategy beats its temporal twin and print the median as a\n");
+            fprintf(stderr, "                 recommended threshold and GLIBC_TUNABLES line\n");
+            fprintf(stderr, "    COPY_IMPL:\n");
+            for (const ms_copy_impl_t *c = ms_copy_impls(); c->name != NULL; c++) {
+                fprintf(stderr, "        %-16s: %s\n", c->name, c->desc);
+            }
+            fprintf(stderr, "\n");
+            fprintf(stderr, "    PASSES: Passes over each shard between progress updates (default %s / shard)\n",
+                human_size(MS_BATCH_BYTES));
+            fprintf(stderr, "    --cycles: Also time with the CPU cycle counter (TSC, CNTVCT) and report bytes per tick\n");
+            fprintf(stderr, "    --energy: Read RAPL package and DRAM (or amd_energy socket) counters around the run\n");
+            fprintf(stderr, "              and report watts, nJ per byte and GB/s per watt\n");
+            fprintf(stderr, "\n");
+            fprintf(stderr, "    BUFFER_SIZE_MB: Buffer size in MB (default 4096), or in KB with a K suffix, e.g. 32K\n");
+            fprintf(stderr, "    INTERVAL: Probe write bandwidth of STRATEGY and load latency (over a second buffer\n");
+            fprintf(stderr, "              of up to %s) this often, e.g. 60s, and publish Prometheus metrics\n",
+                human_size(DAEMON_LATENCY_SIZE));
+            fprintf(stderr, "              A probe writes TRANSFER_SIZE_GB, default %d buffer passes\n", DAEMON_PASSES);
+            fprintf(stderr, "    TEXTFILE: node_exporter textfile collector file, e.g. .../memspeed.prom\n");
+            fprintf(stderr, "    SOCKET: Unix socket path; each connection receives the latest metrics\n");
+            fprintf(stderr, "    BUDGET_PCT: Max share of one CPU spent probing, stretches INTERVAL (default 1)\n");
+            fprintf(stderr, "\n");
+            fprintf(stderr, "    SUITE_FILE: Runs to execute in one process, one grid per line of space separated\n");
+            fprintf(stderr, "                KEY=VALUE[,VALUE...] for every combination.  Keys: strategy (c),\n");
+            fprintf(stderr, "                size (4096, as BUFFER_SIZE_MB[K]), threads (1), source (malloc),\n");
+            fprintf(stderr, "                pages (base), sched (static), transfer (TRANSFER_SIZE_GB).  Of the\n");
+            fprintf(stderr, "                other options only --trans[fer], --batch and --verbose apply\n");
             fprintf(stderr, "\n");
             fprintf(stderr, "    TRANSFER_SIZE_GB: Total amount to transfer through memory in GB\n");
+            fprintf(stderr, "    SCHED: static (default), one equal shard per thread, or chunked, threads claim\n");
+            fprintf(stderr, "           CHUNK_KB chunks of the whole buffer until the transfer is done\n");
+            fprintf(stderr, "    CHUNK_KB: Chunked work unit (default %s, at most the shard size)\n",
+                human_size(MS_CHUNK_SIZE));
+            fprintf(stderr, "    LAYOUT: Static shard ownership, contiguous (default) ranges, or interleaved between\n");
+            fprintf(stderr, "            threads every line, page or BLOCK_BYTES block, each thread's blocks in one\n");
+            fprintf(stderr, "            strided call.  all compares every layout's speed and slowest/fastest thread\n");
+            fprintf(stderr, "    OFFSET: Shift the start of each shard (or chunk) by 0..63 bytes; shards end a page\n");
+            fprintf(stderr, "            early to stay in bounds.  Strategies with aligned stores need a multiple\n");
+            fprintf(stderr, "            of their width, the _u strategies take any OFFSET\n");
+            fprintf(stderr, "    DURATION: Soak for a fixed time instead of TRANSFER_SIZE_GB, e.g. 90s, 30m, 12h\n");
+            fprintf(stderr, "    INTERVAL_SECS: Soak sampling interval for speed, CPU freq and temps (default 10)\n");
+            fprintf(stderr, "    BASELINE_FILE: Saved run config and speed stats; --compare re-runs its config\n");
+            fprintf(stderr, "    THRESHOLD_PCT: Max allowed regression of the avg and median speed, exits 2 past it\n");
+            fprintf(stderr, "                   (default 5)\n");
+            fprintf(stderr, "    EXTREME_PCT: Also gate the min and max 100 ms window speed at this, looser, regression\n");
+            fprintf(stderr, "                 (default off)\n");
             exit(0);
         } else {
-            buffer_size_mb = str_to_pos_u64(argv[i]);
+            buffer_size = str_to_buffer_size(argv[i]);
         }
     }
-    size_t buffer_size = buffer_size_mb * MB;
-    if (!buffer_size || (buffer_size % (g_page_size * g_thread_count))) {
-        size_t div = g_page_size * g_thread_count;
+    if (suite_path != NULL) {
+        check_suite_args(argc, argv);
+        suite_t suite;
+        load_suite(suite_path, transfer_size_gb * GB, &suite);
+        printf("Suite: %s, %zu runs\n", suite_path, suite.count);
+        run_suite_mode(&ctx, &suite);
+        free(suite.runs);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    baseline_t base;
+    if (compare_path != NULL) {
+        load_baseline(compare_path, &base);
+        strategy = base.strategy;
+        buffer_size = base.buffer_size;
+        transfer_size_gb = base.transfer_size / GB;
+        ctx.threads = base.threads;
+        source = base.source;
+        pages = base.pages;
+        char cur_s[32];
+        char base_s[32];
+        warn_baseline_override("SCHED", sched, "static", base.sched);
+        sched = base.sched;
+        snprintf(cur_s, sizeof(cur_s), "%zu", chunk_kb * 1024);
+        snprintf(base_s, sizeof(base_s), "%zu", base.chunk_size);
+        warn_baseline_override("chunk bytes", cur_s, "0", base_s);
+        chunk_kb = base.chunk_size / 1024;
+        warn_baseline_override("LAYOUT", layout, "contiguous", base.layout);
+        layout = base.layout;
+        snprintf(cur_s, sizeof(cur_s), "%zu", block_bytes);
+        snprintf(base_s, sizeof(base_s), "%zu", base.block_size);
+        warn_baseline_override("BLOCK_BYTES", cur_s, "0", base_s);
+        block_bytes = base.block_size;
+        snprintf(cur_s, sizeof(cur_s), "%zu", ctx.offset);
+        snprintf(base_s, sizeof(base_s), "%zu", base.offset);
+        warn_baseline_override("OFFSET", cur_s, "0", base_s);
+        ctx.offset = base.offset;
+        snprintf(cur_s, sizeof(cur_s), "%zu", ctx.batch);
+        snprintf(base_s, sizeof(base_s), "%zu", base.batch);
+        warn_baseline_override("PASSES", cur_s, "0", base_s);
+        ctx.batch = base.batch;
+        apply_baseline_cpus(&base);
+    }
+    if (duration > 0 && (compare_path != NULL || save_path != NULL)) {
+        fprintf(stderr, "Baselines require a fixed TRANSFER_SIZE, not --duration\n");
+        exit(1);
+    }
+    if (daemon.interval > 0 && daemon.textfile == NULL && daemon.socket_path == NULL) {
+        fprintf(stderr, "--daemon requires --textfile or --socket\n");
+        exit(1);
+    }
+    if (!buffer_size || (buffer_size % (ctx.page_size * ctx.threads))) {
+        size_t div = ctx.page_size * ctx.threads;
         buffer_size = buffer_size > div ?
             (buffer_size / div) * div :
             div;
         fprintf(stderr, "WARNING: Adjusting BUFFER_SIZE: %s\n", human_size(buffer_size));
     }
-    size_t shard_size = buffer_size / g_thread_count;
+    size_t shard_size = buffer_size / ctx.threads;
     size_t transfer_size = transfer_size_gb * GB;
+    if (daemon.interval > 0 && !transfer_set) {
+        transfer_size = DAEMON_PASSES * buffer_size;
+    }
+    if (compare_path != NULL) {
+        buffer_size = base.buffer_size;
+        transfer_size = base.transfer_size;
+    }
     if (transfer_size % buffer_size) {
         transfer_size = transfer_size > buffer_size ?
             (transfer_size / buffer_size) * buffer_size :
             buffer_size;
         fprintf(stderr, "NOTE: Adjusting TRANSFER_SIZE: %s\n", human_size(transfer_size));
     }
-    assert(buffer_size && buffer_size % g_page_size == 0);
-    assert(shard_size && shard_size % g_page_size == 0);
-    assert(transfer_size && transfer_size % g_page_size == 0);
-    mem_write_test test;
-    if (strcmp(strategy, "c") == 0) {
-        test = mem_write_test_c;
-    } else if (strcmp(strategy, "c_x8") == 0) {
-        test = mem_write_test_c_x8;
-    } else if (strcmp(strategy, "c_x32") == 0) {
-        test = mem_write_test_c_x32;
-    } else if (strcmp(strategy, "c_x128") == 0) {
-        test = mem_write_test_c_x128;
-    } else if (strcmp(strategy, "memset") == 0) {
-        test = mem_write_test_memset;
-    } else if (strcmp(strategy, "memcpy") == 0) {
-        test = mem_write_test_memcpy;
-#ifdef __x86_64__
-    } else if (strcmp(strategy, "x86asm") == 0) {
-        test = mem_write_test_x86asm;
-    } else if (strcmp(strategy, "x86asm_nt") == 0) {
-        test = mem_write_test_x86asm_nt;
-    } else if (strcmp(strategy, "x86asm_x8") == 0) {
-        test = mem_write_test_x86asm_x8;
-    } else if (strcmp(strategy, "x86asm_nt_x8") == 0) {
-        test = mem_write_test_x86asm_nt_x8;
-    } else if (strcmp(strategy, "x86asm_x32") == 0) {
-        test = mem_write_test_x86asm_x32;
-    } else if (strcmp(strategy, "x86asm_nt_x32") == 0) {
-        test = mem_write_test_x86asm_nt_x32;
-#endif
-#ifdef __AVX2__
-    } else if (strcmp(strategy, "avx2") == 0) {
-        test = mem_write_test_avx2;
-    } else if (strcmp(strategy, "avx2_nt") == 0) {
-        test = mem_write_test_avx2_nt;
-# ifdef __AVX512F__
-    } else if (strcmp(strategy, "avx512") == 0) {
-        test = mem_write_test_avx512;
-    } else if (strcmp(strategy, "avx512_nt") == 0) {
-        test = mem_write_test_avx512_nt;
-# endif
-#endif
-#ifdef __aarch64__
-    } else if (strcmp(strategy, "armasm") == 0) {
-        test = mem_write_test_armasm;
-    } else if (strcmp(strategy, "armasm_x8") == 0) {
-        test = mem_write_test_armasm_x8;
-    } else if (strcmp(strategy, "armasm_nt") == 0) {
-        test = mem_write_test_armasm_nt;
-    } else if (strcmp(strategy, "armasm_nt_x8") == 0) {
-        test = mem_write_test_armasm_nt_x8;
-# ifdef __ARM_NEON
-    } else if (strcmp(strategy, "armneon") == 0) {
-        test = mem_write_test_armneon;
-# endif
-#endif
-    } else {
+    assert(buffer_size && buffer_size % ctx.page_size == 0);
+    assert(shard_size && shard_size % ctx.page_size == 0);
+    assert(transfer_size && transfer_size % ctx.page_size == 0);
+    if (source == NULL) {
+        // populate needs a mapping, which the heap can't give.
+        source = fault_mode ? "private" : "malloc";
+    }
+    ms_buffer_t buf = {.size = buffer_size, .map_sync = map_sync};
+    parse_source(source, &buf);
+    if (fault_mode && buf.source == MS_SOURCE_MALLOC) {
+        fprintf(stderr, "--faults needs an mmap SOURCE, e.g. private (default with --faults)\n");
+        exit(1);
+    }
+    if (ms_pages_parse(pages, &buf.pages) != 0) {
+        fprintf(stderr, "Invalid PAGES: %s\n", pages);
+        exit(1);
+    }
+    if (ms_sched_parse(sched, &ctx.sched) != 0) {
+        fprintf(stderr, "Invalid SCHED: %s\n", sched);
+        exit(1);
+    }
+    ctx.chunk_size = chunk_kb * 1024;
+    size_t chunk_size = ms_chunk_size(&ctx, buffer_size);
+    if (ctx.sched == MS_SCHED_CHUNKED && (chunk_size % ctx.page_size || buffer_size % chunk_size)) {
+        fprintf(stderr, "Invalid CHUNK_KB: %zu, must be whole pages dividing BUFFER_SIZE\n", chunk_kb);
+        exit(1);
+    }
+    const bool layout_all = strcmp(layout, "all") == 0;
+    if (!layout_all && ms_layout_parse(layout, &ctx.layout) != 0) {
+        fprintf(stderr, "Invalid LAYOUT: %s\n", layout);
+        exit(1);
+    }
+    ctx.block_size = block_bytes;
+    if (block_bytes && (block_bytes % MS_CACHE_LINE || shard_size % block_bytes)) {
+        fprintf(stderr, "Invalid BLOCK_BYTES: %zu, must be whole lines dividing the thread shard\n",
+            block_bytes);
+        exit(1);
+    }
+    if (ctx.layout == MS_LAYOUT_BLOCK && !block_bytes) {
+        fprintf(stderr, "The block LAYOUT needs --block BLOCK_BYTES\n");
+        exit(1);
+    }
+    if ((layout_all || ctx.layout != MS_LAYOUT_CONTIGUOUS) && (ctx.sched != MS_SCHED_STATIC || ctx.offset)) {
+        fprintf(stderr, "Interleaved layouts need static scheduling and no OFFSET\n");
+        exit(1);
+    }
+    const size_t trim = ctx.offset ? ctx.page_size : 0;
+    if (fault_mode) {
+        buf.size = shard_size;
+        printf("Fault test: %zu x %s mappings [%s], %zu rounds\n", ctx.threads,
+            human_size(shard_size), source, transfer_size / buffer_size);
+        run_fault_mode(&ctx, &buf, transfer_size / buffer_size);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    const ms_strategy_t *strat = ms_strategy_find(strategy);
+    if (strat == NULL) {
         fprintf(stderr, "Invalid test strategy\n");
         exit(1);
     }
-    printf("Strategy: %s\n", strategy);
-    printf("Page size: %s\n", human_size(g_page_size));
-    printf("Transfer size: %s\n", human_size(transfer_size));
-    if (g_thread_count > 1) {
-        printf("Threads: %ld\n", g_thread_count);
-        printf("Thread shard: %s\n", human_size(buffer_size / g_thread_count));
+    if (!layout_all && !layout_fits(&ctx, strat, shard_size)) {
+        fprintf(stderr, "Strategy %s writes %zu byte units, more than the %s layout blocks\n", strategy,
+            strat->unit ? strat->unit : ctx.page_size, layout);
+        exit(1);
+    }
+    if (!strategy_fits(&ctx, strat)) {
+        fprintf(stderr, "Strategy %s needs %zu byte aligned stores, use a multiple of that as OFFSET "
+            "or an _u strategy\n", strategy, strat->align);
+        exit(1);
+    }
+    soak_state_t soak;
+    if (duration > 0) {
+        soak_init(&soak, duration, MIN(interval, duration));
+        g_soak = &soak;
+        // Run until the soak callback stops us.
+        transfer_size = SIZE_MAX / buffer_size * buffer_size;
     }
-    printf("Allocating memory [%s]: %s\n", use_mmap ? "mmap" : "malloc", human_size(buffer_size));
-    void *mem = alloc(buffer_size, use_mmap);
+    progress_state_t progress = {.soak = g_soak};
+    ctx.progress = on_progress;
+    ctx.progress_arg = &progress;
+    if (mlp_chains) {
+        printf("MLP test: up to %zu chains, %lu loads each\n", mlp_chains, MLP_LOADS);
+    } else if (align_step) {
+        printf("Alignment test: offsets 0..63 step %zu, at least %s per measurement\n", align_step,
+            human_size(ALIGN_MIN_BYTES));
+    } else if (copy_mode) {
+        printf("Copy test: at least %s per measurement\n", human_size(COPY_MIN_BYTES));
+    } else if (spsc_pairs) {
+        printf("SPSC test: %zu pairs, %s ring, %zu B messages in batches of %zu\n", spsc_pairs,
+            human_size(spsc.ring_size), spsc.msg_size, spsc.batch);
+    } else if (gather_mode) {
+        printf("Gather/scatter test: at least %s elements per measurement\n",
+            human_count(GATHER_MIN_ELEMENTS));
+    } else if (flush_mode) {
+        printf("Write back test: %s per strategy\n", human_size(transfer_size));
+    } else if (crossover_threads) {
+        printf("Crossover test: up to %zu threads, at least %s per measurement\n", crossover_threads,
+            human_size(CROSSOVER_BYTES));
+    } else {
+        printf("Strategy: %s\n", strategy);
+    }
+    if (daemon.interval > 0) {
+        printf("Daemon: probe every %.0f s, at most %g%% of a CPU\n", daemon.interval, daemon.budget);
+    }
+    printf("Page size: %s\n", human_size(ctx.page_size));
+    if (g_soak) {
+        printf("Duration: %.0f s (%.0f s intervals)\n", g_soak->duration, g_soak->interval);
+    } else if (!mlp_chains && !copy_mode && !crossover_threads && !flush_mode &&
+               !gather_mode && !spsc_pairs && !align_step) {
+        printf("Transfer size: %s\n", human_size(transfer_size));
+    }
+    if (ctx.threads > 1 && !mlp_chains && !copy_mode && !crossover_threads && !gather_mode &&
+        !spsc_pairs && !align_step) {
+        printf("Threads: %ld\n", ctx.threads);
+        if (ctx.sched == MS_SCHED_CHUNKED) {
+            printf("Chunks: %s, claimed dynamically\n", human_size(chunk_size));
+        } else if (layout_all) {
+            printf("Thread shard: %s, every layout\n", human_size(buffer_size / ctx.threads));
+        } else if (ctx.layout != MS_LAYOUT_CONTIGUOUS) {
+            printf("Thread shard: %s, %s interleaved in %s blocks\n", human_size(buffer_size / ctx.threads),
+                layout, human_size(ms_layout_block(&ctx, shard_size)));
+        } else {
+            printf("Thread shard: %s\n", human_size(buffer_size / ctx.threads));
+        }
+    }
+    if (ctx.offset > 0) {
+        printf("Shard offset: %zu bytes, each shard ends a page early\n", ctx.offset);
+    }
+    printf("Allocating memory [%s%s%s%s]: %s\n", source, map_sync ? ", MAP_SYNC" : "",
+        buf.pages != MS_PAGES_BASE ? ", " : "", buf.pages != MS_PAGES_BASE ? pages : "",
+        human_size(buffer_size));
+    if (ms_alloc(&ctx, &buf) != 0) {
+        fprintf(stderr, "%s\n", ms_error(&ctx));
+        exit(1);
+    }
+    void *mem = buf.mem;
     printf("Pre-faulting memory...\n");
-    // NOTE: Memset can get optimized out, must write by hand...
-    for (size_t i = 0; i < buffer_size; i++) {
-        ((char*) mem)[i] = 0b01010101;
-        (void) ((char*) mem)[i];
+    ms_prefault(mem, buffer_size);
+    if (daemon.interval > 0) {
+        // Same memory type, but never a second mapping of a user's file.
+        ms_buffer_t lat_buf = {
+            .size = MIN(buffer_size, DAEMON_LATENCY_SIZE),
+            .source = buf.source == MS_SOURCE_FILE ? MS_SOURCE_PRIVATE : buf.source,
+            .pages = buf.pages,
+        };
+        ms_mlp_t mlp;
+        printf("Linking latency chain: %s\n", human_size(lat_buf.size));
+        if (ms_alloc(&ctx, &lat_buf) != 0 || ms_mlp_init(&ctx, &mlp, lat_buf.mem, lat_buf.size) != 0) {
+            fprintf(stderr, "%s\n", ms_error(&ctx));
+            exit(1);
+        }
+        daemon.strategy = strategy;
+        fflush(stdout);
+        run_daemon_mode(&ctx, &daemon, mem, buffer_size, transfer_size, strat, &mlp);
+        ms_mlp_destroy(&mlp);
+        ms_dealloc(&lat_buf);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (spsc_pairs) {
+        spsc.messages = (transfer_set ? transfer_size_gb * GB : SPSC_DEFAULT_BYTES) / spsc.msg_size;
+        run_spsc_mode(&ctx, mem, buffer_size, &spsc, spsc_pairs);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (gather_mode) {
+        run_gather_mode(&ctx, mem, buffer_size);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (flush_mode) {
+        run_flush_mode(&ctx, mem, buffer_size, transfer_size);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (crossover_threads) {
+        run_crossover_mode(&ctx, mem, buffer_size, crossover_threads);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (align_step) {
+        run_align_mode(&ctx, mem, buffer_size, align_step);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (copy_mode) {
+        run_copy_mode(&ctx, mem, buffer_size);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (mlp_chains) {
+        run_mlp_mode(&ctx, mem, buffer_size, mlp_chains);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    if (layout_all) {
+        run_layout_mode(&ctx, mem, buffer_size, transfer_size, strat);
+        ms_dealloc(&buf);
+        ms_ctx_destroy(&ctx);
+        return 0;
+    }
+    ms_energy_t energy;
+    if (report_energy) {
+        if (ms_energy_open(&ctx, &energy) != 0) {
+            fprintf(stderr, "WARNING: No energy report: %s\n", ms_error(&ctx));
+        } else {
+            ctx.energy = &energy;
+        }
     }
     signal(SIGINT, on_interrupted);
     printf("Running test...\n");
-    if (g_thread_count > 1) {
-        bench_threaded(mem, buffer_size, transfer_size, test);
+    int rc;
+    if (ctx.threads > 1) {
+        rc = ms_bench_threaded(&ctx, mem, buffer_size, transfer_size, strat->test);
     } else {
-        bench(mem, buffer_size, transfer_size, test);
+        rc = ms_bench(&ctx, mem, buffer_size, transfer_size, strat->test);
+    }
+    printf("\n");
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", ms_error(&ctx));
+        exit(1);
     }
-    double end_time = get_time();
     printf("\nCOMPLETED\n\n");
-    dealloc(mem, buffer_size, use_mmap);
-    print_results(end_time - g_start_time);
-    return 0;
+    print_results(ctx.transferred, ctx.end_time - ctx.start_time);
+    if (report_ticks) {
+        print_ticks(&ctx);
+    }
+    if (ctx.energy != NULL) {
+        print_energy(&ctx);
+    }
+    if (ctx.threads > 1 && ctx.sched == MS_SCHED_CHUNKED) {
+        print_threads(&ctx, chunk_size - trim, "Chunks");
+    } else if (ctx.threads > 1) {
+        print_threads(&ctx, shard_size - trim, "Passes");
+    }
+    if (report_sync) {
+        double msync_time;
+        double fdatasync_time;
+        if (ms_sync(&ctx, &buf, &msync_time, &fdatasync_time) != 0) {
+            fprintf(stderr, "Sync: %s\n", ms_error(&ctx));
+        } else {
+            printf("msync: %.3f ms (%s/s)\n", msync_time * 1000,
+                human_size(buffer_size / MAX(msync_time, 1e-9)));
+            printf("fdatasync: %.3f ms\n", fdatasync_time * 1000);
+        }
+    }
+    ms_dealloc(&buf);
+    if (g_soak) {
+        printf("\n");
+        print_soak_summary(g_soak);
+        soak_free(g_soak);
+    }
+    int exit_code = 0;
+    if (save_path != NULL || compare_path != NULL) {
+        baseline_t cur = {
+            .buffer_size = buffer_size,
+            .transfer_size = transfer_size,
+            .threads = ctx.threads,
+            .chunk_size = chunk_kb * 1024,
+            .block_size = block_bytes,
+            .offset = ctx.offset,
+            .batch = ctx.batch,
+            .stats = compute_stats(&progress.stats, ctx.transferred, ctx.end_time - ctx.start_time),
+        };
+        snprintf(cur.strategy, sizeof(cur.strategy), "%s", strategy);
+        snprintf(cur.source, sizeof(cur.source), "%s", source);
+        snprintf(cur.pages, sizeof(cur.pages), "%s", pages);
+        snprintf(cur.sched, sizeof(cur.sched), "%s", sched);
+        snprintf(cur.layout, sizeof(cur.layout), "%s", layout);
+        format_cpus(&ctx, cur.cpus, sizeof(cur.cpus));
+        print_stats(&cur.stats);
+        if (save_path != NULL) {
+            save_baseline(save_path, &cur);
+            printf("Saved baseline: %s\n", save_path);
+        }
+        if (compare_path != NULL) {
+            printf("\nBaseline: %s\n", compare_path);
+            if (!compare_baseline(&base, &cur, threshold, extreme_threshold)) {
+                exit_code = 2;
+            }
+        }
+    }
+    free(progress.stats.samples);
+    ms_ctx_destroy(&ctx);
+    return exit_code;
 }
@@ -0,0 +1,382 @@
+#ifndef MEMSPEED_H
+#define MEMSPEED_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+
+#define MS_TB (1UL * 1024 * 1024 * 1024 * 1024)
+#define MS_GB (1UL * 1024 * 1024 * 1024)
+#define MS_MB (1UL * 1024 * 1024)
+
+#define MS_CACHE_LINE 64
+#define MS_MLP_MAX_CHAINS 32
+#define MS_ENERGY_MAX_DOMAINS 16
+#define MS_SPSC_MAX_PAIRS 256
+
+// Bytes each worker writes between progress updates when ctx->batch is 0.
+#define MS_BATCH_BYTES (4 * MS_MB)
+
+// Largest default chunk for MS_SCHED_CHUNKED when ctx->chunk_size is 0.
+#define MS_CHUNK_SIZE (1 * MS_MB)
+
+
+typedef void (*ms_write_test)(void *ptr, size_t size, size_t iter);
+
+// Write blocks blocks of block bytes each, stride bytes apart, as one call.
+typedef void (*ms_strided_test)(void *ptr, size_t block, size_t stride, size_t blocks, size_t iter);
+
+typedef void (*ms_copy_fn)(void *dst, const void *src, size_t n);
+
+typedef struct ms_copy_impl {
+    const char *name;
+    const char *desc;
+    ms_copy_fn copy;
+} ms_copy_impl_t;
+
+typedef struct ms_copy_result {
+    size_t size;
+    size_t copies;
+    double time;
+} ms_copy_result_t;
+
+typedef struct ms_strategy {
+    const char *name;
+    const char *desc;
+    ms_write_test test;
+    ms_strided_test strided;    // test over interleaved blocks
+    size_t align;               // Start alignment the stores need, 0 for none
+    size_t unit;                // Sizes must be a multiple of this, 0 for whole pages
+} ms_strategy_t;
+
+typedef enum ms_source {
+    MS_SOURCE_MALLOC,       // aligned_alloc() heap
+    MS_SOURCE_PRIVATE,      // MAP_PRIVATE|MAP_ANONYMOUS
+    MS_SOURCE_SHARED,       // MAP_SHARED|MAP_ANONYMOUS
+    MS_SOURCE_MEMFD,        // MAP_SHARED over memfd_create() (Linux)
+    MS_SOURCE_FILE,         // MAP_SHARED over a file, e.g. on tmpfs or hugetlbfs
+} ms_source_t;
+
+typedef enum ms_pages {
+    MS_PAGES_BASE,
+    MS_PAGES_THP,           // madvise(MADV_HUGEPAGE) transparent huge pages
+    MS_PAGES_HUGETLB,       // MAP_HUGETLB / MFD_HUGETLB, needs reserved huge pages
+} ms_pages_t;
+
+typedef enum ms_sched {
+    MS_SCHED_STATIC,        // One equal shard and pass count per worker
+    MS_SCHED_CHUNKED,       // Workers claim chunks of the whole buffer until the transfer is met
+} ms_sched_t;
+
+typedef enum ms_layout {
+    MS_LAYOUT_CONTIGUOUS,   // Worker i owns shard i, one range of the buffer
+    MS_LAYOUT_LINE,         // Ownership rotates between workers every cache line
+    MS_LAYOUT_PAGE,         // ... every page
+    MS_LAYOUT_BLOCK,        // ... every ctx->block_size bytes
+} ms_layout_t;
+
+typedef struct ms_buffer {
+    // Settings
+    size_t size;
+    ms_source_t source;
+    const char *path;       // MS_SOURCE_FILE: a file, or a directory for an unlinked temp file
+    bool map_sync;          // MS_SOURCE_FILE: MAP_SYNC, needs a DAX capable filesystem
+    bool populate;          // Fault everything in at map time (MAP_POPULATE)
+    ms_pages_t pages;
+
+    // Set by ms_alloc
+    void *mem;
+    int fd;
+} ms_buffer_t;
+
+typedef enum ms_fault_test {
+    MS_FAULT_TOUCH,         // First touch of a fresh, lazily faulted mapping
+    MS_FAULT_POPULATE,      // Map with populate, so faults happen inside mmap
+    MS_FAULT_REFAULT,       // madvise(MADV_DONTNEED) then touch again
+    MS_FAULT_MUNMAP,        // Unmap a touched mapping, incl. TLB shootdowns
+    MS_FAULT_TESTS
+} ms_fault_test_t;
+
+typedef struct ms_fault_result {
+    size_t pages;           // Pages handled across all threads
+    size_t page_size;       // Huge page size for THP and hugetlb buffers
+    double thread_rate;     // Mean pages/s of each thread
+    double time;            // Time of the slowest thread
+} ms_fault_result_t;
+
+// A buffer linked into one random cycle of cache lines for pointer chasing.
+typedef struct ms_mlp {
+    void *mem;
+    size_t lines;
+    uint32_t *order;        // Cycle position -> line index
+} ms_mlp_t;
+
+typedef struct ms_mlp_result {
+    size_t chains;
+    size_t loads;           // Dependent loads across all chains
+    double time;
+    double latency;         // Seconds per load within one chain
+    double rate;            // Lines per second across all chains
+} ms_mlp_result_t;
+
+typedef enum ms_index_pattern {
+    MS_INDEX_SEQUENTIAL,    // 0, 1, 2 .. wrapping at the table size
+    MS_INDEX_CLUSTERED,     // Every element of a cache line, lines in random order
+    MS_INDEX_RANDOM,        // Uniform random elements
+    MS_INDEX_PATTERNS
+} ms_index_pattern_t;
+
+// Sum table[idx[i]], or store v to table[idx[i]], for n indices.
+typedef uint64_t (*ms_gather_fn)(const uint64_t *table, const uint32_t *idx, size_t n);
+typedef void (*ms_scatter_fn)(uint64_t *table, const uint32_t *idx, size_t n, uint64_t v);
+
+typedef struct ms_index_impl {
+    const char *name;
+    const char *desc;
+    ms_gather_fn gather;
+    ms_scatter_fn scatter;      // NULL without a matching scatter instruction
+    size_t max_elements;        // Largest table its indices reach, 2^31 where they are sign extended
+} ms_index_impl_t;
+
+typedef struct ms_index {
+    uint32_t *idx;
+    size_t count;
+    size_t elements;            // 64bit table entries the indices cover
+} ms_index_t;
+
+typedef struct ms_index_result {
+    size_t elements;            // Elements gathered or scattered
+    double time;
+} ms_index_result_t;
+
+// Load count accesses of one vector width, or store v to them, stride bytes
+// apart from ptr, at any alignment.
+typedef uint64_t (*ms_align_load_fn)(const void *ptr, size_t count, size_t stride);
+typedef void (*ms_align_store_fn)(void *ptr, size_t count, size_t stride, uint64_t v);
+
+typedef struct ms_align_impl {
+    const char *name;
+    const char *desc;
+    size_t width;               // Bytes per access
+    ms_align_load_fn load;
+    ms_align_store_fn store;
+} ms_align_impl_t;
+
+typedef struct ms_align_result {
+    size_t accesses;
+    double time;
+} ms_align_result_t;
+
+// One energy counter: a RAPL package or DRAM zone, or an amd_energy socket.
+typedef struct ms_energy_domain {
+    char name[64];              // e.g. "package-0", "package-0/dram", "Esocket0"
+    char path[256];
+    uint64_t max_uj;            // Counter wraps here, 0 if unknown
+    uint64_t start_uj;
+    double joules;              // Used by the last run
+} ms_energy_domain_t;
+
+typedef struct ms_energy {
+    ms_energy_domain_t domains[MS_ENERGY_MAX_DOMAINS];
+    size_t count;
+} ms_energy_t;
+
+// Where the consumer of each producer/consumer pair runs.
+typedef enum ms_placement {
+    MS_PLACE_SMT,           // SMT sibling of the producer's core
+    MS_PLACE_L3,            // Another core sharing the producer's L3
+    MS_PLACE_SOCKET,        // A core in another package
+    MS_PLACE_ANY,           // Next allowed CPU, no topology needed
+    MS_PLACEMENTS
+} ms_placement_t;
+
+typedef struct ms_spsc {
+    size_t ring_size;           // Bytes of message slots per ring
+    size_t msg_size;            // Multiple of 8 bytes
+    size_t batch;               // Messages published or consumed at a time
+    size_t messages;            // Per pair, rounded down to whole batches
+} ms_spsc_t;
+
+typedef struct ms_spsc_result {
+    size_t pairs;
+    size_t messages;            // Across all pairs
+    double time;                // Slowest pair
+    double pair_rate;           // Mean messages/s of each pair
+} ms_spsc_result_t;
+
+typedef struct ms_ctx ms_ctx_t;
+
+// Called by ms_bench after every pass from the benchmarking thread and by
+// ms_bench_threaded from the coordinating thread while it holds the
+// progress lock, so ctx->transferred is stable for the duration of the call.
+// Setting ctx->stop ends the run early.
+typedef void (*ms_progress_cb)(ms_ctx_t *ctx, void *arg);
+
+// All state for one benchmark run lives here, so independent contexts may
+// be used concurrently from different threads.  Initialize with ms_ctx_init,
+// adjust the settings, then reuse across as many runs as needed.
+struct ms_ctx {
+    // Settings
+    size_t page_size;
+    size_t threads;
+    FILE *log;                  // Verbose diagnostics, NULL for silent
+    ms_progress_cb progress;
+    void *progress_arg;
+    size_t batch;               // Passes per progress update, 0 picks from the shard size
+    ms_sched_t sched;           // ms_bench_threaded work distribution
+    size_t chunk_size;          // MS_SCHED_CHUNKED, 0 for MS_CHUNK_SIZE capped at the shard size
+    ms_energy_t *energy;        // Sampled around every ms_bench run when set, see ms_energy_open
+    ms_layout_t layout;         // MS_SCHED_STATIC ownership of the buffer
+    size_t block_size;          // MS_LAYOUT_BLOCK, a multiple of MS_CACHE_LINE
+    size_t offset;              // Shift each shard (or chunk) start by 0..63 bytes; the
+                                // shifted shard then ends a page early to stay in bounds
+
+    // Run state and results, reset at the start of each run
+    double start_time;
+    double end_time;
+    uint64_t start_ticks;       // ms_ticks() around the run
+    uint64_t end_ticks;
+    size_t transferred;
+    atomic_bool stop;
+    int *thread_cpus;           // CPU each worker was pinned to, -1 if unpinned
+    size_t *thread_chunks;      // Chunks, or shard passes for MS_SCHED_STATIC, each worker wrote
+    double *thread_times;       // Seconds each worker spent writing
+
+    char error[256];
+};
+
+
+int ms_ctx_init(ms_ctx_t *ctx);
+void ms_ctx_destroy(ms_ctx_t *ctx);
+
+// Last error message for functions returning -1 or NULL.
+const char *ms_error(const ms_ctx_t *ctx);
+
+// NULL terminated table of the write strategies built for this CPU, less
+// write back kernels whose instructions CPUID or HWCAP does not report.
+const ms_strategy_t *ms_strategies(void);
+const ms_strategy_t *ms_strategy_find(const char *name);
+
+// NULL terminated table of the copy implementations built for this CPU.
+const ms_copy_impl_t *ms_copy_impls(void);
+
+// Repeat one size copy from src to dst until at least min_bytes have moved.
+// Buffers are never touched outside the timed loop, so callers may reuse them.
+int ms_copy_bench(ms_ctx_t *ctx, const ms_copy_impl_t *impl, void *dst, const void *src,
+                  size_t size, size_t min_bytes, ms_copy_result_t *result);
+
+// NULL terminated table of the gather/scatter implementations built for this CPU.
+const ms_index_impl_t *ms_index_impls(void);
+const char *ms_index_pattern_name(ms_index_pattern_t pattern);
+
+// Fill count (a multiple of 16) indices into a table of elements 64bit
+// entries, at most 2^32, with a fixed seed.
+int ms_index_init(ms_ctx_t *ctx, ms_index_t *index, ms_index_pattern_t pattern, size_t elements,
+                  size_t count);
+void ms_index_destroy(ms_index_t *index);
+
+// Gather (or scatter) through every index of index until at least
+// min_elements have moved.
+int ms_index_bench(ms_ctx_t *ctx, const ms_index_impl_t *impl, bool scatter, uint64_t *table,
+                   const ms_index_t *index, size_t min_elements, ms_index_result_t *result);
+
+// NULL terminated table of the unaligned load/store kernels built for this CPU.
+const ms_align_impl_t *ms_align_impls(void);
+
+// Load (or store) count accesses stride bytes apart from ptr until at least
+// min_accesses were made, after one warm up pass.  ptr + (count - 1) * stride
+// + impl->width must stay inside the caller's buffer.
+int ms_align_bench(ms_ctx_t *ctx, const ms_align_impl_t *impl, bool store, void *ptr, size_t count,
+                   size_t stride, size_t min_accesses, ms_align_result_t *result);
+
+// Find the readable package and DRAM energy counters.  Fails with a reason
+// when there are none, e.g. no RAPL or no permission to read energy_uj.
+int ms_energy_open(ms_ctx_t *ctx, ms_energy_t *energy);
+
+const char *ms_placement_name(ms_placement_t placement);
+int ms_placement_parse(const char *name, ms_placement_t *placement);
+
+// Pick pairs producer/consumer CPUs from the allowed set into cpus, as
+// producer, consumer, producer ...  Fails when the topology has no such
+// pairs, e.g. MS_PLACE_SOCKET on one package.
+int ms_spsc_pairs(ms_ctx_t *ctx, ms_placement_t placement, size_t pairs, int *cpus);
+
+// Stream cfg->messages messages from each producer to its consumer through
+// a lock-free ring in mem, one ring per pair.  Consumers verify every
+// message's sequence number.
+int ms_spsc_bench(ms_ctx_t *ctx, void *mem, size_t size, const ms_spsc_t *cfg, size_t pairs,
+                  const int *cpus, ms_spsc_result_t *result);
+
+// Monotonic clock in seconds.
+double ms_time(void);
+
+// Raw cycle counter: the TSC on x86, CNTVCT_EL0 on Aarch64, 0 elsewhere.
+// The TSC ticks at the nominal clock and the Aarch64 generic timer far
+// slower, so neither counts core cycles under turbo or frequency scaling.
+uint64_t ms_ticks(void);
+
+// Passes of size bytes one worker runs between progress updates.
+size_t ms_batch_passes(const ms_ctx_t *ctx, size_t size);
+
+const char *ms_source_name(ms_source_t source);
+int ms_source_parse(const char *name, ms_source_t *source);
+
+const char *ms_pages_name(ms_pages_t pages);
+int ms_pages_parse(const char *name, ms_pages_t *pages);
+
+const char *ms_sched_name(ms_sched_t sched);
+int ms_sched_parse(const char *name, ms_sched_t *sched);
+
+// Chunk size MS_SCHED_CHUNKED uses for buffer_size split over ctx->threads.
+size_t ms_chunk_size(const ms_ctx_t *ctx, size_t buffer_size);
+
+const char *ms_layout_name(ms_layout_t layout);
+int ms_layout_parse(const char *name, ms_layout_t *layout);
+
+// Bytes a worker owns before the next worker's turn: the whole shard for
+// MS_LAYOUT_CONTIGUOUS, else a line, a page or ctx->block_size.
+size_t ms_layout_block(const ms_ctx_t *ctx, size_t shard_size);
+
+// PMD sized huge page used for THP and the default hugetlb pool.
+size_t ms_huge_page_size(void);
+
+// Map or allocate buf->size bytes from buf->source into buf->mem.
+int ms_alloc(ms_ctx_t *ctx, ms_buffer_t *buf);
+void ms_dealloc(ms_buffer_t *buf);
+void ms_prefault(void *mem, size_t size);
+
+// Write back a dirty fd backed buffer, timing msync(MS_SYNC) and fdatasync()
+// separately.  Returns -1 for buffers without a backing fd.
+int ms_sync(ms_ctx_t *ctx, ms_buffer_t *buf, double *msync_time, double *fdatasync_time);
+
+const char *ms_fault_test_name(ms_fault_test_t test);
+
+// Each of ctx->threads pinned workers allocates its own buf->size mapping
+// like buf and runs the test rounds times, timing only the faulting step.
+int ms_fault_bench(ms_ctx_t *ctx, const ms_buffer_t *buf, ms_fault_test_t test, size_t rounds,
+                   ms_fault_result_t *result);
+
+// Link every cache line of mem into a single random cycle.  Overwrites mem.
+int ms_mlp_init(ms_ctx_t *ctx, ms_mlp_t *mlp, void *mem, size_t size);
+void ms_mlp_destroy(ms_mlp_t *mlp);
+
+// Walk 1..MS_MLP_MAX_CHAINS evenly spaced chains of the cycle interleaved in
+// one loop on the calling thread, loads / chains steps each.
+int ms_mlp_run(ms_ctx_t *ctx, ms_mlp_t *mlp, size_t chains, size_t loads, ms_mlp_result_t *result);
+
+// Write transfer_size bytes through mem, buffer_size bytes per pass.
+// ms_bench_threaded splits mem into ctx->threads equal shards, one per pinned
+// worker, laid out by ctx->layout as one range or interleaved blocks, or with
+// MS_SCHED_CHUNKED has the workers claim ms_chunk_size() chunks of all of mem
+// from a shared counter, so fast cores do more of the work instead of waiting
+// on slow ones.  Passes are run ms_batch_passes() at a time between updates of
+// ctx->transferred and progress callbacks, so cache sized buffers measure the
+// kernel rather than the bookkeeping.  Both return 0 on success and -1 with
+// ms_error() set on failure.
+int ms_bench(ms_ctx_t *ctx, void *mem, size_t buffer_size, size_t transfer_size, ms_write_test test);
+int ms_bench_threaded(ms_ctx_t *ctx, void *mem, size_t buffer_size, size_t transfer_size, ms_write_test test);
+
+#endif  // MEMSPEED_H
@@ -0,0 +1,36 @@
+#ifndef MEMSPEED_INTERNAL_H
+#define MEMSPEED_INTERNAL_H
+
+// Shared between the libmemspeed translation units, not installed.
+
+#include "memspeed.h"
+
+
+// Small, fast PRNG for the randomized layouts; callers seed it with a fixed
+// value so every run and host gets the same pattern.
+static inline uint64_t ms_xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+void ms_set_error(ms_ctx_t *ctx, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void ms_log(ms_ctx_t *ctx, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Bracket the timed region of a run; energy may be NULL.
+void ms_energy_start(ms_energy_t *energy);
+void ms_energy_stop(ms_energy_t *energy);
+
+// Run fn(args + i * arg_size) on ctx->threads workers, pinned the same way as
+// ms_bench_threaded and released together once all are ready.
+int ms_run_pinned(ms_ctx_t *ctx, void (*fn)(void *arg), void *args, size_t arg_size);
+
+// Same for thread_count workers, worker i pinned to cpus[i] (Linux only).
+// cpus may be NULL to spread them like ms_run_pinned.
+int ms_run_on_cpus(ms_ctx_t *ctx, void (*fn)(void *arg), void *args, size_t arg_size,
+                   size_t thread_count, const int *cpus);
+
+#endif  // MEMSPEED_INTERNAL_H
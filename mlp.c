@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+int ms_mlp_init(ms_ctx_t *ctx, ms_mlp_t *mlp, void *mem, size_t size) {
+    memset(mlp, 0, sizeof(*mlp));
+    size_t lines = size / MS_CACHE_LINE;
+    if (lines < MS_MLP_MAX_CHAINS || lines > UINT32_MAX) {
+        ms_set_error(ctx, "Invalid MLP buffer size");
+        return -1;
+    }
+    uint32_t *order = malloc(lines * sizeof(uint32_t));
+    if (order == NULL) {
+        ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        return -1;
+    }
+    // Fixed seed so every run and host walks the same pattern.
+    uint64_t rng = 0x9e3779b97f4a7c15;
+    for (size_t i = 0; i < lines; i++) {
+        order[i] = i;
+    }
+    for (size_t i = lines - 1; i > 0; i--) {
+        size_t j = ms_xorshift64(&rng) % (i + 1);
+        uint32_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    char *base = mem;
+    for (size_t i = 0; i < lines; i++) {
+        void **line = (void**) (base + (size_t) order[i] * MS_CACHE_LINE);
+        *line = base + (size_t) order[(i + 1) % lines] * MS_CACHE_LINE;
+    }
+    mlp->mem = mem;
+    mlp->lines = lines;
+    mlp->order = order;
+    return 0;
+}
+
+
+void ms_mlp_destroy(ms_mlp_t *mlp) {
+    free(mlp->order);
+    mlp->order = NULL;
+}
+
+
+// Always inlined with a constant chain count so the chain pointers live in
+// registers and the inner loop is fully unrolled.
+static inline __attribute__((always_inline))
+uintptr_t chase(void **heads, const size_t chains, size_t steps) {
+    void *p[MS_MLP_MAX_CHAINS];
+    for (size_t k = 0; k < chains; k++) {
+        p[k] = heads[k];
+    }
+    for (size_t i = 0; i < steps; i++) {
+        for (size_t k = 0; k < chains; k++) {
+            p[k] = *(void**) p[k];
+        }
+    }
+    uintptr_t sink = 0;
+    for (size_t k = 0; k < chains; k++) {
+        sink += (uintptr_t) p[k];
+    }
+    return sink;
+}
+
+
+#define CHASE_CASE(n) case n: return chase(heads, n, steps);
+
+static uintptr_t chase_n(void **heads, size_t chains, size_t steps) {
+    switch (chains) {
+    CHASE_CASE(1) CHASE_CASE(2) CHASE_CASE(3) CHASE_CASE(4)
+    CHASE_CASE(5) CHASE_CASE(6) CHASE_CASE(7) CHASE_CASE(8)
+    CHASE_CASE(9) CHASE_CASE(10) CHASE_CASE(11) CHASE_CASE(12)
+    CHASE_CASE(13) CHASE_CASE(14) CHASE_CASE(15) CHASE_CASE(16)
+    CHASE_CASE(17) CHASE_CASE(18) CHASE_CASE(19) CHASE_CASE(20)
+    CHASE_CASE(21) CHASE_CASE(22) CHASE_CASE(23) CHASE_CASE(24)
+    CHASE_CASE(25) CHASE_CASE(26) CHASE_CASE(27) CHASE_CASE(28)
+    CHASE_CASE(29) CHASE_CASE(30) CHASE_CASE(31) CHASE_CASE(32)
+    default:
+        return 0;
+    }
+}
+
+
+int ms_mlp_run(ms_ctx_t *ctx, ms_mlp_t *mlp, size_t chains, size_t loads, ms_mlp_result_t *result) {
+    if (chains < 1 || chains > MS_MLP_MAX_CHAINS || loads < chains) {
+        ms_set_error(ctx, "Invalid MLP args");
+        return -1;
+    }
+    // Heads are spread evenly around the cycle, so chains stay disjoint for
+    // up to lines / chains steps.
+    void *heads[MS_MLP_MAX_CHAINS];
+    for (size_t k = 0; k < chains; k++) {
+        heads[k] = (char*) mlp->mem + (size_t) mlp->order[k * (mlp->lines / chains)] * MS_CACHE_LINE;
+    }
+    const size_t steps = loads / chains;
+    volatile uintptr_t sink;
+    sink = chase_n(heads, chains, MAX(steps / 16, 1));  // Warm up TLBs and clocks
+    ctx->start_time = ms_time();
+    sink = chase_n(heads, chains, steps);
+    ctx->end_time = ms_time();
+    (void) sink;
+    memset(result, 0, sizeof(*result));
+    result->chains = chains;
+    result->loads = steps * chains;
+    result->time = ctx->end_time - ctx->start_time;
+    result->latency = result->time / steps;
+    result->rate = result->loads / result->time;
+    return 0;
+}
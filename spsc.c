@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/param.h>
+
+#include "memspeed.h"
+#include "memspeed_internal.h"
+
+
+// Producer and consumer indices live on their own lines at the start of the
+// ring's region, slots follow on the next page.
+typedef struct spsc_ring {
+    _Alignas(MS_CACHE_LINE) atomic_size_t head;     // Messages published
+    _Alignas(MS_CACHE_LINE) atomic_size_t tail;     // Messages consumed
+} spsc_ring_t;
+
+typedef struct spsc_worker {
+    ms_ctx_t *ctx;
+    spsc_ring_t *ring;
+    char *slots;
+    size_t slot_count;
+    const ms_spsc_t *cfg;
+    size_t messages;
+    bool producer;
+    double start_time;
+    double end_time;
+    size_t errors;
+} spsc_worker_t;
+
+
+static const char *placement_names[] = {
+    [MS_PLACE_SMT] = "smt",
+    [MS_PLACE_L3] = "l3",
+    [MS_PLACE_SOCKET] = "socket",
+    [MS_PLACE_ANY] = "any",
+};
+
+
+const char *ms_placement_name(ms_placement_t placement) {
+    return placement_names[placement];
+}
+
+
+int ms_placement_parse(const char *name, ms_placement_t *placement) {
+    for (size_t i = 0; i < sizeof(placement_names) / sizeof(placement_names[0]); i++) {
+        if (strcmp(placement_names[i], name) == 0) {
+            *placement = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+static inline void cpu_relax(size_t *spins) {
+#if defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+    // Give the partner a chance when both share an oversubscribed CPU.
+    if (++*spins % 4096 == 0) {
+        sched_yield();
+    }
+}
+
+
+#ifdef __linux__
+// Read a sysfs CPU list such as "0-3,8-11" into set.
+static int read_cpu_list(const char *path, cpu_set_t *set) {
+    CPU_ZERO(set);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int lo, hi;
+    char sep = ',';
+    while (sep == ',' && fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1) {
+                break;
+            }
+            if (fscanf(f, "%c", &sep) != 1) {
+                sep = '\n';
+            }
+        }
+        for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+
+static int read_cpu_int(int cpu, const char *file) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, file);
+    FILE *f = fopen(path, "r");
+    int value = -1;
+    if (f != NULL) {
+        if (fscanf(f, "%d", &value) != 1) {
+            value = -1;
+        }
+        fclose(f);
+    }
+    return value;
+}
+
+
+// CPUs sharing the highest level cache of cpu, normally the L3.
+static int read_llc_cpus(int cpu, cpu_set_t *set) {
+    for (int index = 4; index >= 0; index--) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        if (read_cpu_list(path, set) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+static bool placement_matches(ms_placement_t placement, int producer, int consumer) {
+    if (placement == MS_PLACE_ANY) {
+        return true;
+    }
+    char path[128];
+    cpu_set_t siblings;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", producer);
+    bool smt = read_cpu_list(path, &siblings) == 0 && CPU_ISSET(consumer, &siblings);
+    if (placement == MS_PLACE_SMT) {
+        return smt;
+    }
+    int package = read_cpu_int(producer, "physical_package_id");
+    int other_package = read_cpu_int(consumer, "physical_package_id");
+    if (placement == MS_PLACE_SOCKET) {
+        return package >= 0 && other_package >= 0 && package != other_package;
+    }
+    cpu_set_t llc;
+    return !smt && read_llc_cpus(producer, &llc) == 0 && CPU_ISSET(consumer, &llc);
+}
+#endif
+
+
+int ms_spsc_pairs(ms_ctx_t *ctx, ms_placement_t placement, size_t pairs, int *cpus) {
+    if (pairs < 1 || pairs > MS_SPSC_MAX_PAIRS) {
+        ms_set_error(ctx, "Invalid pair count");
+        return -1;
+    }
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    cpu_set_t used;
+    CPU_ZERO(&used);
+    size_t found = 0;
+    for (int producer = 0; producer < CPU_SETSIZE && found < pairs; producer++) {
+        if (!CPU_ISSET(producer, &allowed) || CPU_ISSET(producer, &used)) {
+            continue;
+        }
+        for (int consumer = 0; consumer < CPU_SETSIZE; consumer++) {
+            if (consumer == producer || !CPU_ISSET(consumer, &allowed) || CPU_ISSET(consumer, &used) ||
+                !placement_matches(placement, producer, consumer)) {
+                continue;
+            }
+            CPU_SET(producer, &used);
+            CPU_SET(consumer, &used);
+            cpus[2 * found] = producer;
+            cpus[2 * found + 1] = consumer;
+            found++;
+            break;
+        }
+    }
+    if (found == pairs) {
+        return 0;
+    }
+    // A lone CPU can still run one unconstrained pair, just time shared.
+    if (placement == MS_PLACE_ANY && found == 0 && pairs == 1 && CPU_COUNT(&allowed) == 1) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus[0] = cpus[1] = cpu;
+                return 0;
+            }
+        }
+    }
+    ms_set_error(ctx, "Only %zu of %zu %s pairs among the allowed CPUs", found, pairs,
+        placement_names[placement]);
+    return -1;
+#else
+    if (placement != MS_PLACE_ANY) {
+        ms_set_error(ctx, "Placement %s needs the Linux CPU topology", placement_names[placement]);
+        return -1;
+    }
+    for (size_t i = 0; i < 2 * pairs; i++) {
+        cpus[i] = -1;
+    }
+    return 0;
+#endif
+}
+
+
+static void spsc_produce(spsc_worker_t *w) {
+    const size_t batch = w->cfg->batch;
+    const size_t words = w->cfg->msg_size / sizeof(uint64_t);
+    const size_t slot_size = w->cfg->msg_size;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t spins = 0;
+    size_t slot = 0;
+    while (head < w->messages) {
+        while (head + batch - tail > w->slot_count) {
+            tail = atomic_load_explicit(&w->ring->tail, memory_order_acquire);
+            if (head + batch - tail > w->slot_count) {
+                if (atomic_load_explicit(&w->ctx->stop, memory_order_relaxed)) {
+                    return;
+                }
+                cpu_relax(&spins);
+            }
+        }
+        for (size_t k = 0; k < batch; k++) {
+            uint64_t *msg = (uint64_t*) (w->slots + slot * slot_size);
+            msg[0] = head + k;
+            for (size_t i = 1; i < words; i++) {
+                msg[i] = head + k + i;
+            }
+            if (++slot == w->slot_count) {
+                slot = 0;
+            }
+        }
+        head += batch;
+        atomic_store_explicit(&w->ring->head, head, memory_order_release);
+    }
+}
+
+
+static void spsc_consume(spsc_worker_t *w) {
+    const size_t batch = w->cfg->batch;
+    const size_t words = w->cfg->msg_size / sizeof(uint64_t);
+    const size_t slot_size = w->cfg->msg_size;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t spins = 0;
+    size_t slot = 0;
+    uint64_t sum = 0;
+    while (tail < w->messages) {
+        while (head - tail < batch) {
+            head = atomic_load_explicit(&w->ring->head, memory_order_acquire);
+            if (head - tail < batch) {
+                if (atomic_load_explicit(&w->ctx->stop, memory_order_relaxed)) {
+                    return;
+                }
+                cpu_relax(&spins);
+            }
+        }
+        for (size_t k = 0; k < batch; k++) {
+            const uint64_t *msg = (const uint64_t*) (w->slots + slot * slot_size);
+            w->errors += msg[0] != tail + k;
+            for (size_t i = 1; i < words; i++) {
+                sum += msg[i];
+            }
+            if (++slot == w->slot_count) {
+                slot = 0;
+            }
+        }
+        tail += batch;
+        atomic_store_explicit(&w->ring->tail, tail, memory_order_release);
+    }
+    volatile uint64_t sink = sum;
+    (void) sink;
+}
+
+
+static void spsc_worker_run(void *arg) {
+    spsc_worker_t *w = arg;
+    w->start_time = ms_time();
+    if (w->producer) {
+        spsc_produce(w);
+    } else {
+        spsc_consume(w);
+    }
+    w->end_time = ms_time();
+}
+
+
+int ms_spsc_bench(ms_ctx_t *ctx, void *mem, size_t size, const ms_spsc_t *cfg, size_t pairs,
+                  const int *cpus, ms_spsc_result_t *result) {
+    const size_t region = ctx->page_size + (cfg->ring_size + ctx->page_size - 1) / ctx->page_size * ctx->page_size;
+    const size_t slot_count = cfg->msg_size > 0 ? cfg->ring_size / cfg->msg_size : 0;
+    const size_t messages = cfg->batch > 0 ? cfg->messages / cfg->batch * cfg->batch : 0;
+    if (cfg->msg_size < sizeof(uint64_t) || cfg->msg_size % sizeof(uint64_t) || cfg->batch < 1 ||
+        slot_count < cfg->batch || messages < 1 || pairs < 1 || pairs > MS_SPSC_MAX_PAIRS) {
+        ms_set_error(ctx, "Invalid SPSC args: ring must hold a batch of messages of 8 byte multiples");
+        return -1;
+    }
+    if (region * pairs > size) {
+        ms_set_error(ctx, "Buffer too small for %zu rings of %zu bytes", pairs, cfg->ring_size);
+        return -1;
+    }
+    spsc_worker_t *workers = calloc(2 * pairs, sizeof(spsc_worker_t));
+    if (workers == NULL) {
+        ms_set_error(ctx, "Mem alloc failed %s", strerror(errno));
+        return -1;
+    }
+    atomic_store(&ctx->stop, false);
+    for (size_t p = 0; p < pairs; p++) {
+        char *base = (char*) mem + p * region;
+        spsc_ring_t *ring = (spsc_ring_t*) base;
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        for (size_t i = 0; i < 2; i++) {
+            spsc_worker_t *w = &workers[2 * p + i];
+            w->ctx = ctx;
+            w->ring = ring;
+            w->slots = base + ctx->page_size;
+            w->slot_count = slot_count;
+            w->cfg = cfg;
+            w->messages = messages;
+            w->producer = i == 0;
+        }
+    }
+    int ret = ms_run_on_cpus(ctx, spsc_worker_run, workers, sizeof(spsc_worker_t), 2 * pairs, cpus);
+    if (ret == 0) {
+        memset(result, 0, sizeof(*result));
+        result->pairs = pairs;
+        result->messages = messages * pairs;
+        size_t errors = 0;
+        for (size_t p = 0; p < pairs; p++) {
+            double time = workers[2 * p + 1].end_time - workers[2 * p].start_time;
+            result->time = MAX(result->time, time);
+            result->pair_rate += messages / time / pairs;
+            errors += workers[2 * p + 1].errors;
+        }
+        if (errors > 0) {
+            ms_set_error(ctx, "%zu messages arrived out of sequence", errors);
+            ret = -1;
+        }
+    }
+    free(workers);
+    return ret;
+}